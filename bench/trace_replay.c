@@ -0,0 +1,919 @@
+/*
+trace_replay.c - public domain - github.com/cofinite
+
+Replays recorded allocation traces against the allocators in this repository
+and against `malloc`, and reports throughput, per-operation latency, peak RSS
+and page faults for each of them.
+
+Build (POSIX, from this directory):
+    cc -O2 -I.. trace_replay.c -o trace_replay -lpthread
+
+Usage:
+    trace_replay TRACE [BACKEND...]
+    trace_replay --generate TRACE THREADS OPS [SEED]
+
+With no BACKEND arguments, every backend is run. Backends:
+    malloc      `malloc`/`free`, with the sizes recorded in the trace
+    mempool     a `MemPool` per thread (memory-pool.h)
+    mempool-split
+                a `MemPoolSplit` per thread, hot part of TR_HOT_SIZE bytes
+    fsba        a `FsbaAllocator` per thread (fixed_size_block_allocator.h),
+                emplaced in a region large enough for the thread's peak
+    fsba-shared a single `FsbaAllocator` shared by all threads, large enough
+                for the peaks of all of them; only built with FSBA_ATOMIC
+
+Built with -DFSBA_ATOMIC, both FSBA backends use the lock-free allocator:
+`fsba` measures its cost without contention, and `fsba-shared` with every
+thread allocating from the same free list.
+
+The pool backends allocate fixed-size objects of TR_OBJECT_SIZE bytes, so the
+size recorded with each allocation only matters to `malloc`. Each backend runs
+in its own child process, so that peak RSS and page faults are its own.
+
+Each backend is replayed twice from scratch. The first pass is untimed per
+operation and gives throughput, RSS and page faults. The second pass reads the
+clock around every operation and gives the latency histograms; their buckets
+are powers of two in nanoseconds, so that the rare resize stands out from the
+common case.
+
+Trace format:
+    The file starts with the 8 magic bytes "MPTRACE1", followed by records of
+    16 bytes each, all integers little-endian:
+        offset 0    u8  op      0 = alloc, 1 = free, 2 = access
+        offset 1    u8  thread  the thread that performs the operation
+        offset 2    u16         reserved, write 0
+        offset 4    u32 size    bytes requested (alloc) or touched (access)
+        offset 8    u64 id      the object, e.g. the address it was given
+    Object ids are scoped to their thread: an object must be freed and
+    accessed by the thread that allocated it. An id may be reused once the
+    object it named has been freed. Operations on unknown ids are counted and
+    skipped.
+
+LICENSE
+
+See end of file for license information.
+
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MEMORY_POOL_IMPLEMENTATION
+#include "memory-pool.h"
+
+#define FSBA_IMPLEMENTATION
+#include "fixed_size_block_allocator.h"
+
+#ifndef TR_OBJECT_SIZE
+#define TR_OBJECT_SIZE 64
+#endif
+
+#ifndef TR_HOT_SIZE
+#define TR_HOT_SIZE 16
+#endif
+
+#define TR_MAX_THREADS  256
+#define TR_BUCKETS      64
+
+enum { TR_ALLOC, TR_FREE, TR_ACCESS, TR_OP_KINDS };
+
+static const char* const trOpNames[TR_OP_KINDS] = { "alloc", "free", "access" };
+
+/* an operation with its object id replaced by a dense slot index */
+typedef struct TrOp {
+    uint32_t kind;
+    uint32_t size;
+    uint32_t slot;
+} TrOp;
+
+typedef struct TrThreadTrace {
+    TrOp* pOps;
+    size_t opCount;
+    size_t opCapacity;
+    uint32_t slotCount;
+    size_t skipped;
+} TrThreadTrace;
+
+
+
+/* backends ---------------------------------------------------------------- */
+
+typedef struct TrBackend {
+    const char* name;
+    void* (*create)(uint32_t slotCount);
+    int   (*alloc)(void* pState, uint32_t slot, uint32_t size);
+    void  (*free)(void* pState, uint32_t slot);
+    void  (*access)(void* pState, uint32_t slot, uint32_t size);
+    void  (*destroy)(void* pState);
+} TrBackend;
+
+typedef struct TrObject {
+    unsigned char bytes[TR_OBJECT_SIZE];
+} TrObject;
+
+typedef struct TrHot {
+    unsigned char bytes[TR_HOT_SIZE];
+} TrHot;
+
+typedef struct TrCold {
+    unsigned char bytes[TR_OBJECT_SIZE - TR_HOT_SIZE];
+} TrCold;
+
+static void trTouch(volatile unsigned char* pBytes, uint32_t size)
+{
+    uint32_t i;
+    for (i = 0; i < size; i += 64) {
+        pBytes[i] += 1;
+    }
+}
+
+static uint32_t trClampSize(uint32_t size)
+{
+    return size < TR_OBJECT_SIZE ? size : TR_OBJECT_SIZE;
+}
+
+/* malloc */
+
+static void* trMallocCreate(uint32_t slotCount)
+{
+    return calloc(slotCount ? slotCount : 1, sizeof(void*));
+}
+
+static int trMallocAlloc(void* pState, uint32_t slot, uint32_t size)
+{
+    void* p = malloc(size ? size : 1);
+    ((void**)pState)[slot] = p;
+    return p != NULL ? 0 : -1;
+}
+
+static void trMallocFree(void* pState, uint32_t slot)
+{
+    free(((void**)pState)[slot]);
+}
+
+static void trMallocAccess(void* pState, uint32_t slot, uint32_t size)
+{
+    trTouch(((void**)pState)[slot], size ? size : 1);
+}
+
+static void trMallocDestroy(void* pState)
+{
+    free(pState);
+}
+
+/* memory-pool.h */
+
+typedef MemPool(TrObject) TrPool;
+
+typedef struct TrPoolState {
+    TrPool pool;
+    size_t handles[1];
+} TrPoolState;
+
+static void* trPoolCreate(uint32_t slotCount)
+{
+    TrPoolState* pState = malloc(
+        sizeof(TrPoolState) + slotCount * sizeof(size_t));
+    if (pState != NULL) {
+        TrPool pool = mpInit(&pool);
+        pState->pool = pool;
+    }
+    return pState;
+}
+
+static int trPoolAlloc(void* pState, uint32_t slot, uint32_t size)
+{
+    TrPoolState* pPool = pState;
+    (void)size;
+    pPool->handles[slot] = mpAlloc(&pPool->pool);
+    return pPool->handles[slot] != MP_INVALID_HANDLE ? 0 : -1;
+}
+
+static void trPoolFree(void* pState, uint32_t slot)
+{
+    TrPoolState* pPool = pState;
+    mpFree(&pPool->pool, pPool->handles[slot]);
+}
+
+static void trPoolAccess(void* pState, uint32_t slot, uint32_t size)
+{
+    TrPoolState* pPool = pState;
+    trTouch(mpAt(&pPool->pool, pPool->handles[slot]).bytes,
+            trClampSize(size ? size : 1));
+}
+
+static void trPoolDestroy(void* pState)
+{
+    TrPoolState* pPool = pState;
+    mpFreePool(&pPool->pool);
+    free(pPool);
+}
+
+/* memory-pool.h, split */
+
+typedef MemPoolSplit(TrHot, TrCold) TrSplitPool;
+
+typedef struct TrSplitState {
+    TrSplitPool pool;
+    size_t handles[1];
+} TrSplitState;
+
+static void* trSplitCreate(uint32_t slotCount)
+{
+    TrSplitState* pState = malloc(
+        sizeof(TrSplitState) + slotCount * sizeof(size_t));
+    if (pState != NULL) {
+        TrSplitPool pool = mpsInit(&pool);
+        pState->pool = pool;
+    }
+    return pState;
+}
+
+static int trSplitAlloc(void* pState, uint32_t slot, uint32_t size)
+{
+    TrSplitState* pPool = pState;
+    (void)size;
+    pPool->handles[slot] = mpsAlloc(&pPool->pool);
+    return pPool->handles[slot] != MP_INVALID_HANDLE ? 0 : -1;
+}
+
+static void trSplitFree(void* pState, uint32_t slot)
+{
+    TrSplitState* pPool = pState;
+    mpsFree(&pPool->pool, pPool->handles[slot]);
+}
+
+/* touches the hot part, and the cold part only if the access reaches it */
+static void trSplitAccess(void* pState, uint32_t slot, uint32_t size)
+{
+    TrSplitState* pPool = pState;
+    size_t handle = pPool->handles[slot];
+    size = trClampSize(size ? size : 1);
+    trTouch(mpsHot(&pPool->pool, handle).bytes,
+            size < TR_HOT_SIZE ? size : TR_HOT_SIZE);
+    if (size > TR_HOT_SIZE) {
+        trTouch(mpsCold(&pPool->pool, handle).bytes, size - TR_HOT_SIZE);
+    }
+}
+
+static void trSplitDestroy(void* pState)
+{
+    TrSplitState* pPool = pState;
+    mpsFreePool(&pPool->pool);
+    free(pPool);
+}
+
+/* fixed_size_block_allocator.h */
+
+typedef struct TrFsbaState {
+    FsbaAllocator* pAllocator;
+    void* pMem;
+    void* blocks[1];
+} TrFsbaState;
+
+static void* trFsbaCreate(uint32_t slotCount)
+{
+    size_t memSize = fsbaAllocatorSize() + 2 * sizeof(TrObject)
+                   + (size_t)slotCount * sizeof(TrObject);
+    TrFsbaState* pState = malloc(
+        sizeof(TrFsbaState) + slotCount * sizeof(void*));
+    if (pState == NULL) return NULL;
+    pState->pMem = malloc(memSize);
+    pState->pAllocator = fsbaEmplaceAllocator(
+        pState->pMem, memSize, sizeof(TrObject), 16, NULL);
+    if (pState->pAllocator == NULL) {
+        free(pState->pMem);
+        free(pState);
+        return NULL;
+    }
+    return pState;
+}
+
+static int trFsbaAlloc(void* pState, uint32_t slot, uint32_t size)
+{
+    TrFsbaState* pFsba = pState;
+    (void)size;
+    pFsba->blocks[slot] = fsbaAllocate(pFsba->pAllocator);
+    return pFsba->blocks[slot] != NULL ? 0 : -1;
+}
+
+static void trFsbaFree(void* pState, uint32_t slot)
+{
+    TrFsbaState* pFsba = pState;
+    fsbaFree(pFsba->pAllocator, pFsba->blocks[slot]);
+}
+
+static void trFsbaAccess(void* pState, uint32_t slot, uint32_t size)
+{
+    TrFsbaState* pFsba = pState;
+    trTouch(pFsba->blocks[slot], trClampSize(size ? size : 1));
+}
+
+static void trFsbaDestroy(void* pState)
+{
+    TrFsbaState* pFsba = pState;
+    free(pFsba->pMem);
+    free(pFsba);
+}
+
+#ifdef FSBA_ATOMIC
+
+/*  The shared allocator is made by the first thread to create its state and
+ *  freed by the last to destroy it, so that every replay starts afresh. The
+ *  states of the threads only hold their blocks.
+ */
+static uint32_t trSharedSlotCount;
+static pthread_mutex_t trSharedMutex = PTHREAD_MUTEX_INITIALIZER;
+static int trSharedRefs;
+static FsbaAllocator* pTrShared;
+static void* pTrSharedMem;
+
+static void trSharedDestroy(void* pState)
+{
+    pthread_mutex_lock(&trSharedMutex);
+    if (--trSharedRefs == 0) {
+        free(pTrSharedMem);
+        pTrSharedMem = NULL;
+        pTrShared = NULL;
+    }
+    pthread_mutex_unlock(&trSharedMutex);
+    free(pState);
+}
+
+static void* trSharedCreate(uint32_t slotCount)
+{
+    size_t memSize = fsbaAllocatorSize() + 2 * sizeof(TrObject)
+                   + (size_t)trSharedSlotCount * sizeof(TrObject);
+    TrFsbaState* pState = malloc(
+        sizeof(TrFsbaState) + slotCount * sizeof(void*));
+    if (pState == NULL) return NULL;
+    pthread_mutex_lock(&trSharedMutex);
+    if (trSharedRefs++ == 0) {
+        pTrSharedMem = malloc(memSize);
+        pTrShared = fsbaEmplaceAllocator(
+            pTrSharedMem, memSize, sizeof(TrObject), 16, NULL);
+    }
+    pState->pAllocator = pTrShared;
+    pState->pMem = NULL;
+    pthread_mutex_unlock(&trSharedMutex);
+    if (pState->pAllocator == NULL) {
+        trSharedDestroy(pState);
+        return NULL;
+    }
+    return pState;
+}
+
+#endif /* FSBA_ATOMIC */
+
+static const TrBackend trBackends[] = {
+    { "malloc", trMallocCreate, trMallocAlloc, trMallocFree,
+      trMallocAccess, trMallocDestroy },
+    { "mempool", trPoolCreate, trPoolAlloc, trPoolFree,
+      trPoolAccess, trPoolDestroy },
+    { "mempool-split", trSplitCreate, trSplitAlloc, trSplitFree,
+      trSplitAccess, trSplitDestroy },
+    { "fsba", trFsbaCreate, trFsbaAlloc, trFsbaFree,
+      trFsbaAccess, trFsbaDestroy },
+#ifdef FSBA_ATOMIC
+    { "fsba-shared", trSharedCreate, trFsbaAlloc, trFsbaFree,
+      trFsbaAccess, trSharedDestroy },
+#endif
+};
+
+#define TR_BACKEND_COUNT (sizeof trBackends / sizeof *trBackends)
+
+
+
+/* loading ----------------------------------------------------------------- */
+
+/*  Maps the live object ids of one thread to dense slots while the trace is
+ *  loaded, so that the replay loop indexes arrays instead of hashing. Freed
+ *  entries become tombstones; the table is sized by the number of allocations
+ *  in the thread, so it never fills up.
+ */
+typedef struct TrIdEntry {
+    uint64_t id;
+    uint32_t slot;
+    uint32_t state; /* 0 = empty, 1 = live, 2 = tombstone */
+} TrIdEntry;
+
+typedef struct TrIdMap {
+    TrIdEntry* pEntries;
+    size_t mask;
+    uint32_t* pFreeSlots;
+    uint32_t freeSlotCount;
+} TrIdMap;
+
+static size_t trHash(uint64_t id)
+{
+    id ^= id >> 33;
+    id *= 0xff51afd7ed558ccdULL;
+    id ^= id >> 33;
+    return (size_t)id;
+}
+
+static TrIdEntry* trFind(TrIdMap* pMap, uint64_t id, int insert)
+{
+    size_t i = trHash(id) & pMap->mask;
+    TrIdEntry* pTombstone = NULL;
+    for (;;) {
+        TrIdEntry* pEntry = &pMap->pEntries[i];
+        if (pEntry->state == 0) {
+            if (!insert) return NULL;
+            return pTombstone != NULL ? pTombstone : pEntry;
+        }
+        if (pEntry->state == 2) {
+            if (pTombstone == NULL) pTombstone = pEntry;
+        }
+        else if (pEntry->id == id) {
+            return pEntry;
+        }
+        i = (i + 1) & pMap->mask;
+    }
+}
+
+static uint64_t trReadLE(const unsigned char* p, int bytes)
+{
+    uint64_t value = 0;
+    while (bytes-- > 0) value = (value << 8) | p[bytes];
+    return value;
+}
+
+static int trPush(TrThreadTrace* pTrace, TrOp op)
+{
+    if (pTrace->opCount == pTrace->opCapacity) {
+        size_t capacity = pTrace->opCapacity ? pTrace->opCapacity * 2 : 1024;
+        TrOp* pOps = realloc(pTrace->pOps, capacity * sizeof(TrOp));
+        if (pOps == NULL) return -1;
+        pTrace->pOps = pOps;
+        pTrace->opCapacity = capacity;
+    }
+    pTrace->pOps[pTrace->opCount++] = op;
+    return 0;
+}
+
+static int trLoad(const char* path, TrThreadTrace* pTraces, int* pThreadCount)
+{
+    static TrIdMap maps[TR_MAX_THREADS];
+    size_t allocCounts[TR_MAX_THREADS] = {0};
+    unsigned char magic[8];
+    unsigned char record[16];
+    FILE* pFile = fopen(path, "rb");
+    int t;
+
+    if (pFile == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fread(magic, 1, 8, pFile) != 8 || memcmp(magic, "MPTRACE1", 8) != 0) {
+        fprintf(stderr, "%s: not a trace file\n", path);
+        fclose(pFile);
+        return -1;
+    }
+
+    /* first pass: count allocations per thread to size the id maps */
+    *pThreadCount = 0;
+    while (fread(record, 1, 16, pFile) == 16) {
+        if (record[0] == TR_ALLOC) allocCounts[record[1]] += 1;
+        if (record[1] + 1 > *pThreadCount) *pThreadCount = record[1] + 1;
+    }
+    for (t = 0; t < *pThreadCount; ++t) {
+        size_t size = 16;
+        while (size < allocCounts[t] * 2) size *= 2;
+        maps[t].pEntries = calloc(size, sizeof(TrIdEntry));
+        maps[t].mask = size - 1;
+        maps[t].pFreeSlots = malloc((allocCounts[t] + 1) * sizeof(uint32_t));
+        maps[t].freeSlotCount = 0;
+        if (maps[t].pEntries == NULL || maps[t].pFreeSlots == NULL) {
+            fprintf(stderr, "out of memory\n");
+            fclose(pFile);
+            return -1;
+        }
+    }
+
+    /* second pass: resolve ids to slots, reusing the slots of freed ids */
+    fseek(pFile, 8, SEEK_SET);
+    while (fread(record, 1, 16, pFile) == 16) {
+        TrThreadTrace* pTrace = &pTraces[record[1]];
+        TrIdMap* pMap = &maps[record[1]];
+        uint64_t id = trReadLE(record + 8, 8);
+        TrIdEntry* pEntry;
+        TrOp op;
+        op.kind = record[0];
+        op.size = (uint32_t)trReadLE(record + 4, 4);
+        if (op.kind == TR_ALLOC) {
+            pEntry = trFind(pMap, id, 1);
+            if (pEntry->state == 1) {
+                pTrace->skipped += 1;
+                continue;
+            }
+            pEntry->id = id;
+            pEntry->state = 1;
+            pEntry->slot = pMap->freeSlotCount > 0
+                ? pMap->pFreeSlots[--pMap->freeSlotCount]
+                : pTrace->slotCount++;
+        }
+        else if (op.kind == TR_FREE || op.kind == TR_ACCESS) {
+            pEntry = trFind(pMap, id, 0);
+            if (pEntry == NULL || pEntry->state != 1) {
+                pTrace->skipped += 1;
+                continue;
+            }
+            if (op.kind == TR_FREE) {
+                pEntry->state = 2;
+                pMap->pFreeSlots[pMap->freeSlotCount++] = pEntry->slot;
+            }
+        }
+        else {
+            pTrace->skipped += 1;
+            continue;
+        }
+        op.slot = pEntry->slot;
+        if (trPush(pTrace, op) != 0) {
+            fprintf(stderr, "out of memory\n");
+            fclose(pFile);
+            return -1;
+        }
+    }
+    fclose(pFile);
+    for (t = 0; t < *pThreadCount; ++t) {
+        free(maps[t].pEntries);
+        free(maps[t].pFreeSlots);
+    }
+    return 0;
+}
+
+
+
+/* replaying --------------------------------------------------------------- */
+
+typedef struct TrWorker {
+    pthread_t thread;
+    const TrBackend* pBackend;
+    const TrThreadTrace* pTrace;
+    pthread_barrier_t* pBarrier;
+    int timed;
+    int failed;
+    uint64_t histogram[TR_OP_KINDS][TR_BUCKETS];
+    uint64_t maxLatency[TR_OP_KINDS];
+} TrWorker;
+
+static uint64_t trNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int trBucket(uint64_t ns)
+{
+    int bucket = 0;
+    while (ns > 1 && bucket < TR_BUCKETS - 1) {
+        ns >>= 1;
+        bucket += 1;
+    }
+    return bucket;
+}
+
+static void trReplay(TrWorker* pWorker, void* pState)
+{
+    const TrBackend* pBackend = pWorker->pBackend;
+    const TrOp* pOp = pWorker->pTrace->pOps;
+    const TrOp* pEnd = pOp + pWorker->pTrace->opCount;
+    for (; pOp < pEnd; ++pOp) {
+        switch (pOp->kind) {
+        case TR_ALLOC:
+            if (pBackend->alloc(pState, pOp->slot, pOp->size) != 0) {
+                pWorker->failed = 1;
+                return;
+            }
+            break;
+        case TR_FREE:
+            pBackend->free(pState, pOp->slot);
+            break;
+        default:
+            pBackend->access(pState, pOp->slot, pOp->size);
+            break;
+        }
+    }
+}
+
+static void trReplayTimed(TrWorker* pWorker, void* pState)
+{
+    const TrBackend* pBackend = pWorker->pBackend;
+    const TrOp* pOp = pWorker->pTrace->pOps;
+    const TrOp* pEnd = pOp + pWorker->pTrace->opCount;
+    for (; pOp < pEnd; ++pOp) {
+        uint64_t begin = trNow();
+        uint64_t ns;
+        switch (pOp->kind) {
+        case TR_ALLOC:
+            if (pBackend->alloc(pState, pOp->slot, pOp->size) != 0) {
+                pWorker->failed = 1;
+                return;
+            }
+            break;
+        case TR_FREE:
+            pBackend->free(pState, pOp->slot);
+            break;
+        default:
+            pBackend->access(pState, pOp->slot, pOp->size);
+            break;
+        }
+        ns = trNow() - begin;
+        pWorker->histogram[pOp->kind][trBucket(ns)] += 1;
+        if (ns > pWorker->maxLatency[pOp->kind]) {
+            pWorker->maxLatency[pOp->kind] = ns;
+        }
+    }
+}
+
+static void* trWorkerMain(void* pArg)
+{
+    TrWorker* pWorker = pArg;
+    void* pState = pWorker->pBackend->create(pWorker->pTrace->slotCount);
+    if (pState == NULL) pWorker->failed = 1;
+    pthread_barrier_wait(pWorker->pBarrier);
+    if (pState != NULL) {
+        if (pWorker->timed) trReplayTimed(pWorker, pState);
+        else trReplay(pWorker, pState);
+    }
+    pthread_barrier_wait(pWorker->pBarrier);
+    if (pState != NULL) pWorker->pBackend->destroy(pState);
+    return NULL;
+}
+
+/* runs every thread of the trace once; returns the wall time in ns */
+static uint64_t trRun(const TrBackend* pBackend, const TrThreadTrace* pTraces,
+                      int threadCount, int timed, TrWorker* pWorkers)
+{
+    pthread_barrier_t barrier;
+    uint64_t begin, end;
+    int t;
+    pthread_barrier_init(&barrier, NULL, (unsigned)threadCount + 1);
+    for (t = 0; t < threadCount; ++t) {
+        memset(&pWorkers[t], 0, sizeof *pWorkers);
+        pWorkers[t].pBackend = pBackend;
+        pWorkers[t].pTrace = &pTraces[t];
+        pWorkers[t].pBarrier = &barrier;
+        pWorkers[t].timed = timed;
+        pthread_create(&pWorkers[t].thread, NULL, trWorkerMain, &pWorkers[t]);
+    }
+    pthread_barrier_wait(&barrier);
+    begin = trNow();
+    pthread_barrier_wait(&barrier);
+    end = trNow();
+    for (t = 0; t < threadCount; ++t) pthread_join(pWorkers[t].thread, NULL);
+    pthread_barrier_destroy(&barrier);
+    return end - begin;
+}
+
+static void trPrintHistogram(const TrWorker* pWorkers, int threadCount)
+{
+    int kind, t, b;
+    for (kind = 0; kind < TR_OP_KINDS; ++kind) {
+        uint64_t counts[TR_BUCKETS] = {0};
+        uint64_t total = 0, seen = 0, maxLatency = 0;
+        double marks[] = { 0.5, 0.99, 0.999 };
+        int mark = 0;
+        for (t = 0; t < threadCount; ++t) {
+            for (b = 0; b < TR_BUCKETS; ++b) {
+                counts[b] += pWorkers[t].histogram[kind][b];
+                total += pWorkers[t].histogram[kind][b];
+            }
+            if (pWorkers[t].maxLatency[kind] > maxLatency) {
+                maxLatency = pWorkers[t].maxLatency[kind];
+            }
+        }
+        if (total == 0) continue;
+        printf("  %s latency (%llu ops, max %llu ns):\n", trOpNames[kind],
+               (unsigned long long)total, (unsigned long long)maxLatency);
+        for (b = 0; b < TR_BUCKETS; ++b) {
+            if (counts[b] == 0) continue;
+            seen += counts[b];
+            printf("    < %12llu ns %12llu", 2ULL << b,
+                   (unsigned long long)counts[b]);
+            while (mark < 3 && (double)seen >= marks[mark] * (double)total) {
+                printf("  p%g", marks[mark] * 100);
+                mark += 1;
+            }
+            printf("\n");
+        }
+    }
+}
+
+static int trBenchmark(const TrBackend* pBackend, const TrThreadTrace* pTraces,
+                       int threadCount)
+{
+    static TrWorker workers[TR_MAX_THREADS];
+    struct rusage before, after;
+    size_t opCount = 0;
+    uint64_t ns;
+    int t;
+
+    for (t = 0; t < threadCount; ++t) opCount += pTraces[t].opCount;
+
+    getrusage(RUSAGE_SELF, &before);
+    ns = trRun(pBackend, pTraces, threadCount, 0, workers);
+    getrusage(RUSAGE_SELF, &after);
+    for (t = 0; t < threadCount; ++t) {
+        if (workers[t].failed) {
+            printf("%s: out of memory in thread %d\n", pBackend->name, t);
+            return 1;
+        }
+    }
+    printf("%s:\n", pBackend->name);
+    printf("  %zu ops in %.3f ms, %.2f Mops/s\n",
+           opCount, ns / 1e6, ns ? opCount * 1e3 / ns : 0.0);
+    printf("  peak RSS %ld KiB, %ld minor and %ld major page faults\n",
+           after.ru_maxrss,
+           after.ru_minflt - before.ru_minflt,
+           after.ru_majflt - before.ru_majflt);
+
+    trRun(pBackend, pTraces, threadCount, 1, workers);
+    trPrintHistogram(workers, threadCount);
+    return 0;
+}
+
+
+
+/* generating -------------------------------------------------------------- */
+
+static void trWriteLE(unsigned char* p, uint64_t value, int bytes)
+{
+    int i;
+    for (i = 0; i < bytes; ++i, value >>= 8) p[i] = (unsigned char)value;
+}
+
+static uint64_t trRandom(uint64_t* pState)
+{
+    *pState ^= *pState << 13;
+    *pState ^= *pState >> 7;
+    *pState ^= *pState << 17;
+    return *pState;
+}
+
+/*  Writes a synthetic trace: every thread runs a random mix of allocations,
+ *  frees of random live objects, and accesses to random live objects.
+ */
+static int trGenerate(const char* path, int threadCount, long opsPerThread,
+                      uint64_t seed)
+{
+    FILE* pFile = fopen(path, "wb");
+    uint64_t* pLive = malloc((size_t)opsPerThread * sizeof(uint64_t));
+    unsigned char record[16] = {0};
+    int t;
+
+    if (pFile == NULL || pLive == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        if (pFile != NULL) fclose(pFile);
+        free(pLive);
+        return 1;
+    }
+    if (fwrite("MPTRACE1", 1, 8, pFile) != 8) goto write_error;
+    for (t = 0; t < threadCount; ++t) {
+        uint64_t state = seed * 0x9e3779b97f4a7c15ULL + (uint64_t)t + 1;
+        uint64_t nextId = (uint64_t)t << 40;
+        size_t liveCount = 0;
+        long i;
+        for (i = 0; i < opsPerThread; ++i) {
+            uint64_t r = trRandom(&state);
+            unsigned roll = (unsigned)(r % 100);
+            size_t pick = liveCount ? (size_t)(r >> 32) % liveCount : 0;
+            record[1] = (unsigned char)t;
+            if (liveCount == 0 || roll < 45) {
+                record[0] = TR_ALLOC;
+                trWriteLE(record + 4, 16 + (r >> 40) % 241, 4);
+                trWriteLE(record + 8, nextId, 8);
+                pLive[liveCount++] = nextId++;
+            }
+            else if (roll < 80) {
+                record[0] = TR_FREE;
+                trWriteLE(record + 4, 0, 4);
+                trWriteLE(record + 8, pLive[pick], 8);
+                pLive[pick] = pLive[--liveCount];
+            }
+            else {
+                record[0] = TR_ACCESS;
+                trWriteLE(record + 4, 64, 4);
+                trWriteLE(record + 8, pLive[pick], 8);
+            }
+            if (fwrite(record, 1, 16, pFile) != 16) goto write_error;
+        }
+    }
+    free(pLive);
+    if (fclose(pFile) != 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    return 0;
+
+write_error:
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    free(pLive);
+    fclose(pFile);
+    return 1;
+}
+
+
+
+int main(int argc, char** argv)
+{
+    static TrThreadTrace traces[TR_MAX_THREADS];
+    int threadCount, i, status = 0;
+    size_t b, skipped = 0;
+
+    if (argc >= 5 && strcmp(argv[1], "--generate") == 0) {
+        char* pEnd;
+        long threads, ops;
+        threads = strtol(argv[3], &pEnd, 10);
+        if (*pEnd != '\0' || threads < 1 || threads > TR_MAX_THREADS) {
+            fprintf(stderr, "THREADS must be in 1..%d\n", TR_MAX_THREADS);
+            goto usage;
+        }
+        errno = 0;
+        ops = strtol(argv[4], &pEnd, 10);
+        if (*pEnd != '\0' || errno != 0 || ops < 1
+            || (unsigned long)ops > SIZE_MAX / sizeof(uint64_t)) {
+            fprintf(stderr, "OPS must be a positive number\n");
+            goto usage;
+        }
+        return trGenerate(argv[2], (int)threads, ops,
+                          argc >= 6 ? strtoull(argv[5], NULL, 10) : 1);
+    }
+    if (argc < 2 || argv[1][0] == '-') goto usage;
+    if (trLoad(argv[1], traces, &threadCount) != 0) return 1;
+    for (i = 0; i < threadCount; ++i) skipped += traces[i].skipped;
+#ifdef FSBA_ATOMIC
+    for (i = 0; i < threadCount; ++i) trSharedSlotCount += traces[i].slotCount;
+#endif
+    printf("%s: %d threads, %zu operations skipped\n",
+           argv[1], threadCount, skipped);
+    fflush(stdout);
+
+    for (b = 0; b < TR_BACKEND_COUNT; ++b) {
+        pid_t pid;
+        int selected = argc == 2, childStatus;
+        for (i = 2; i < argc; ++i) {
+            if (strcmp(argv[i], trBackends[b].name) == 0) selected = 1;
+        }
+        if (!selected) continue;
+        pid = fork();
+        if (pid == 0) {
+            status = trBenchmark(&trBackends[b], traces, threadCount);
+            fflush(stdout);
+            _exit(status);
+        }
+        if (pid < 0 || waitpid(pid, &childStatus, 0) < 0
+            || !WIFEXITED(childStatus) || WEXITSTATUS(childStatus) != 0) {
+            status = 1;
+        }
+    }
+    return status;
+
+usage:
+    fprintf(stderr,
+            "usage: %s TRACE [BACKEND...]\n"
+            "       %s --generate TRACE THREADS OPS [SEED]\n",
+            argv[0], argv[0]);
+    return 1;
+}
+
+/*
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+
+*/
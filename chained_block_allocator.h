@@ -0,0 +1,385 @@
+/*
+chained_block_allocator.h - public domain - github.com/cofinite
+
+In exactly one source file, put:
+    #define CHAINED_BLOCK_ALLOCATOR_IMPLEMENTATION
+    #include "chained_block_allocator.h"
+
+Other source or header files should have just:
+    #include "chained_block_allocator.h"
+
+This library is built on fixed_size_block_allocator.h, which must be available
+to include, and whose implementation must be compiled in some source file.
+
+
+The purpose of this library is to keep fixed-size block allocation going once
+the memory given to a `FsbaAllocator` runs out, without every call site having
+to handle `NULL`. A chained block allocator allocates from a `FsbaAllocator`
+first, and only goes to an upstream source of memory once that is exhausted.
+
+An upstream is a pair of functions, with a pointer passed to both:
+
+    CbaUpstream upstream = cbaMallocUpstream();
+
+It can be used in two ways. Given a region size, the chained allocator takes
+regions of that size from upstream, and adds them to its `FsbaAllocator` with
+`fsbaAddMemory`, so that it grows without bound and keeps allocating at the
+speed of a `FsbaAllocator`:
+
+    static char mem[1 << 16];
+    CbaAllocator* allocator = cbaEmplaceAllocator(
+        mem, sizeof mem, sizeof(MyObjectType), alignof(MyObjectType),
+        &upstream, 1 << 20);
+
+Given a region size of 0, it instead passes every allocation it cannot serve
+on to upstream, one block at a time, and sends blocks back there when they are
+freed; `cbaFree` tells them apart by address:
+
+    CbaAllocator* allocator = cbaEmplaceAllocator(
+        mem, sizeof mem, sizeof(MyObjectType), alignof(MyObjectType),
+        &upstream, 0);
+
+Either way, blocks are allocated and freed with `cbaAllocate` and `cbaFree`:
+
+    MyObjectType* obj = cbaAllocate(allocator);
+    cbaFree(allocator, obj);
+
+    cbaDestroyAllocator(allocator);
+
+Besides `cbaMallocUpstream`, `cbaBlockUpstream` takes regions from the blocks of
+a parent `FsbaAllocator`, whose blocks must then be at least as large as the
+region size. Other upstreams, like `pmMap` and `pmUnmap` of page_memory.h, are
+a pair of functions away. Upstream memory must be aligned at least as strictly
+as the blocks, which memory from `malloc` is for all fundamental types.
+
+With `FSBA_ATOMIC`, `fsbaAddMemory` is not available, so only the region size
+0 is supported. A chained block allocator is then as thread-safe as its
+upstream.
+
+LICENSE
+
+See end of file for license information.
+
+*/
+
+#ifndef CBA_INCLUDE_CHAINED_BLOCK_ALLOCATOR_H
+#define CBA_INCLUDE_CHAINED_BLOCK_ALLOCATOR_H
+
+#include <stddef.h>
+
+#include "fixed_size_block_allocator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! @brief A source of memory for a chained block allocator.
+ *  
+ *  A source of memory for a chained block allocator.
+ */
+typedef struct CbaUpstream {
+    void* (*pfnAllocate)(void* pUser, size_t size); /* returns `NULL` when out of memory */
+    void (*pfnFree)(void* pUser, void* pMem, size_t size);
+    void* pUser;
+} CbaUpstream;
+
+/*! @brief Opaque allocator object.
+ *  
+ *  Opaque allocator object.
+ */
+typedef struct CbaAllocator CbaAllocator;
+
+/*! @brief Emplaces a chained block allocator in the given memory.
+ *  
+ *  This function constructs an allocator in-place within the memory passed to
+ *  it, and emplaces a `FsbaAllocator` in the rest of the memory.
+ *  
+ *  @param[in] pMem Pointer to the memory to be used by the allocator.
+ *  
+ *  @param[in] memSize The size of the memory pointed to by `pMem`. It may be
+ *  too small to hold any blocks, in which case all blocks come from upstream.
+ *  
+ *  @param[in] blockSize The fixed size of the memory blocks to be allocated.
+ *  
+ *  @param[in] blockAlign The alignment requirement of the memory blocks.
+ *  
+ *  @param[in] pUpstream The upstream to take memory from once the memory
+ *  passed to this function is used up. It is copied.
+ *  
+ *  @param[in] regionSize The size of the regions to take from upstream, or 0
+ *  to take single blocks. Must be 0 with `FSBA_ATOMIC`.
+ *  
+ *  @return A handle to the allocator, or `NULL` if not given enough memory for
+ *  the allocator itself.
+ */
+CbaAllocator* cbaEmplaceAllocator(
+    void* pMem,
+    size_t memSize,
+    size_t blockSize,
+    size_t blockAlign,
+    const CbaUpstream* pUpstream,
+    size_t regionSize);
+
+/*! @brief Returns the memory taken from upstream.
+ *  
+ *  This function gives all regions the allocator has taken from upstream
+ *  back to it. Blocks that were taken from upstream one by one must have been
+ *  freed. The allocator must not be used afterwards.
+ *  
+ *  @param[in] pAllocator Handle to the allocator, or `NULL`.
+ */
+void cbaDestroyAllocator(CbaAllocator* pAllocator);
+
+/*! @brief Allocates a memory block.
+ *  
+ *  This function allocates a block from the allocator's `FsbaAllocator`, and
+ *  from upstream if that is out of memory.
+ *  
+ *  @param[in] pAllocator Handle to the allocator from which to request the
+ *  memory block.
+ *  
+ *  @return A pointer to the memory block, or `NULL` if upstream is out of
+ *  memory as well.
+ */
+void* cbaAllocate(CbaAllocator* pAllocator);
+
+/*! @brief Frees a memory block.
+ *  
+ *  This function frees a memory block that has previously been returned by a
+ *  call to `cbaAllocate`, to wherever it came from.
+ *  
+ *  @param[in] pAllocator Handle to the allocator from which the memory block
+ *  was previously requested.
+ *  
+ *  @param[in] pBlock Pointer to the memory block to be freed, or `NULL`.
+ */
+void cbaFree(CbaAllocator* pAllocator, void* pBlock);
+
+/*! @brief Returns the underlying fixed-size block allocator.
+ *  
+ *  @param[in] pAllocator Handle to the allocator.
+ *  
+ *  @return A handle to the `FsbaAllocator` the allocator allocates from first.
+ */
+FsbaAllocator* cbaBlockAllocator(const CbaAllocator* pAllocator);
+
+/*! @brief Returns an upstream that allocates with `malloc`.
+ *  
+ *  @return An upstream whose functions call `malloc` and `free`.
+ */
+CbaUpstream cbaMallocUpstream(void);
+
+/*! @brief Returns an upstream that allocates blocks of another allocator.
+ *  
+ *  @param[in] pParent Handle to the allocator to allocate from. Its blocks
+ *  must be at least as large as any size asked of the upstream.
+ *  
+ *  @return An upstream whose functions call `fsbaAllocate` and `fsbaFree`.
+ */
+CbaUpstream cbaBlockUpstream(FsbaAllocator* pParent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CBA_INCLUDE_CHAINED_BLOCK_ALLOCATOR_H */
+
+
+
+#if defined(CHAINED_BLOCK_ALLOCATOR_IMPLEMENTATION) && !defined(CHAINED_BLOCK_ALLOCATOR_IMPLEMENTATION_INCLUDED)
+#define CHAINED_BLOCK_ALLOCATOR_IMPLEMENTATION_INCLUDED
+
+#include <stdlib.h>
+
+/* header at the beginning of every region taken from upstream */
+struct cba_Region {
+    struct cba_Region* pNext;
+};
+
+struct CbaAllocator {
+    FsbaAllocator* pBlocks;
+    CbaUpstream upstream;
+    size_t regionSize;
+    size_t blockSize;
+    struct cba_Region* pRegions;
+};
+
+#define cba_alignof(type) offsetof(struct {char x; type y;}, y)
+
+static void* cba_alignUp(void* ptr, size_t align)
+{
+    return (char*)ptr + (align - ((((size_t)ptr - 1) % align) + 1));
+}
+
+CbaAllocator* cbaEmplaceAllocator(
+    void* pMem,
+    size_t memSize,
+    size_t blockSize,
+    size_t blockAlign,
+    const CbaUpstream* pUpstream,
+    size_t regionSize)
+{
+    CbaAllocator* pAllocator;
+    char* pRest;
+    
+    if (pMem == NULL) return NULL;
+    
+#ifdef FSBA_ATOMIC
+    if (regionSize != 0) return NULL;
+#endif
+    if (regionSize != 0 && regionSize <= sizeof(struct cba_Region)) return NULL;
+    
+    pAllocator = cba_alignUp(pMem, cba_alignof(CbaAllocator));
+    pRest = (char*)(pAllocator + 1);
+    if (pRest > (char*)pMem + memSize) return NULL;
+    
+    /* the blocks of an exhausted allocator are served from upstream, so even none will do */
+    pAllocator->pBlocks = fsbaEmplaceAllocator(
+        pRest, (size_t)((char*)pMem + memSize - pRest), blockSize, blockAlign, NULL);
+    if (pAllocator->pBlocks == NULL) return NULL;
+    
+    pAllocator->upstream = *pUpstream;
+    pAllocator->regionSize = regionSize;
+    pAllocator->blockSize = blockSize;
+    pAllocator->pRegions = NULL;
+    
+    return pAllocator;
+}
+
+void cbaDestroyAllocator(CbaAllocator* pAllocator)
+{
+    struct cba_Region* pRegion;
+    struct cba_Region* pNext;
+    
+    if (pAllocator == NULL) return;
+    for (pRegion = pAllocator->pRegions; pRegion != NULL; pRegion = pNext) {
+        pNext = pRegion->pNext;
+        pAllocator->upstream.pfnFree(pAllocator->upstream.pUser, pRegion, pAllocator->regionSize);
+    }
+    pAllocator->pRegions = NULL;
+}
+
+/* kept apart from `cbaAllocate`, so that its fast path stays small */
+static void* cba_allocateUpstream(CbaAllocator* pAllocator)
+{
+    struct cba_Region* pRegion;
+    
+    if (pAllocator->regionSize == 0) {
+        return pAllocator->upstream.pfnAllocate(pAllocator->upstream.pUser, pAllocator->blockSize);
+    }
+    
+#ifndef FSBA_ATOMIC
+    pRegion = (struct cba_Region*)pAllocator->upstream.pfnAllocate(
+        pAllocator->upstream.pUser, pAllocator->regionSize);
+    if (pRegion == NULL) return NULL;
+    
+    if (fsbaAddMemory(pAllocator->pBlocks, pRegion + 1,
+            pAllocator->regionSize - sizeof *pRegion) == 0) {
+        pAllocator->upstream.pfnFree(pAllocator->upstream.pUser, pRegion, pAllocator->regionSize);
+        return NULL;
+    }
+    pRegion->pNext = pAllocator->pRegions;
+    pAllocator->pRegions = pRegion;
+#else
+    (void)pRegion;
+#endif
+    return fsbaAllocate(pAllocator->pBlocks);
+}
+
+void* cbaAllocate(CbaAllocator* pAllocator)
+{
+    void* pBlock = fsbaAllocate(pAllocator->pBlocks);
+    if (pBlock != NULL) return pBlock;
+    return cba_allocateUpstream(pAllocator);
+}
+
+void cbaFree(CbaAllocator* pAllocator, void* pBlock)
+{
+    /* regions belong to the block allocator, so only single blocks need telling apart */
+    if (pAllocator->regionSize == 0 && pBlock != NULL && !fsbaOwns(pAllocator->pBlocks, pBlock)) {
+        pAllocator->upstream.pfnFree(pAllocator->upstream.pUser, pBlock, pAllocator->blockSize);
+        return;
+    }
+    fsbaFree(pAllocator->pBlocks, pBlock);
+}
+
+FsbaAllocator* cbaBlockAllocator(const CbaAllocator* pAllocator)
+{
+    return pAllocator->pBlocks;
+}
+
+static void* cba_mallocAllocate(void* pUser, size_t size)
+{
+    (void)pUser;
+    return malloc(size);
+}
+
+static void cba_mallocFree(void* pUser, void* pMem, size_t size)
+{
+    (void)pUser;
+    (void)size;
+    free(pMem);
+}
+
+CbaUpstream cbaMallocUpstream(void)
+{
+    CbaUpstream upstream;
+    upstream.pfnAllocate = cba_mallocAllocate;
+    upstream.pfnFree = cba_mallocFree;
+    upstream.pUser = NULL;
+    return upstream;
+}
+
+static void* cba_blockAllocate(void* pUser, size_t size)
+{
+    (void)size;
+    return fsbaAllocate((FsbaAllocator*)pUser);
+}
+
+static void cba_blockFree(void* pUser, void* pMem, size_t size)
+{
+    (void)size;
+    fsbaFree((FsbaAllocator*)pUser, pMem);
+}
+
+CbaUpstream cbaBlockUpstream(FsbaAllocator* pParent)
+{
+    CbaUpstream upstream;
+    upstream.pfnAllocate = cba_blockAllocate;
+    upstream.pfnFree = cba_blockFree;
+    upstream.pUser = pParent;
+    return upstream;
+}
+
+#undef cba_alignof
+
+#endif /* CHAINED_BLOCK_ALLOCATOR_IMPLEMENTATION */
+
+/*
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+
+*/
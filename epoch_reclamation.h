@@ -0,0 +1,445 @@
+/*
+epoch_reclamation.h - public domain - github.com/cofinite
+
+In exactly one source file, put:
+    #define EPOCH_RECLAMATION_IMPLEMENTATION
+    #include "epoch_reclamation.h"
+
+Other source or header files should have just:
+    #include "epoch_reclamation.h"
+
+This library is built on fixed_size_block_allocator.h, which must be available
+to include, and whose implementation must be compiled in some source file.
+`FSBA_ATOMIC` must be defined wherever fixed_size_block_allocator.h is
+included.
+
+
+The purpose of this library is to free the nodes of lock-free data structures
+safely. A thread that unlinks a node from a lock-free queue or map cannot free
+it right away, as other threads may still be reading it. With epoch-based
+reclamation, threads instead retire the node, and it is freed once every thread
+has moved on past the point where it could have seen it.
+
+Nodes are blocks of an atomic `FsbaAllocator`, which all threads share through
+a domain:
+
+    static EbrDomain domain;
+    ebrInitDomain(&domain, allocator);
+
+Every thread that reads or retires nodes registers itself once, and brackets
+all accesses to the data structure between `ebrEnter` and `ebrLeave`. Within
+such a critical section, nodes that are retired stay valid:
+
+    EbrThread thread;
+    ebrRegisterThread(&domain, &thread);
+
+    ebrEnter(&thread);
+    Node* node = pop(&queue);
+    if (node != NULL) ebrRetire(&thread, node);
+    ebrLeave(&thread);
+
+    ebrUnregisterThread(&thread);
+
+A domain counts epochs. It moves on to the next epoch once every thread inside
+a critical section has seen the current one, and a node retired in one epoch
+can no longer be seen two epochs later. Every thread keeps the nodes it has
+retired in three limbo lists, one for each of the last epochs, and frees a list
+at once with `fsbaFreeN` when its epoch is old enough. The limbo lists are
+themselves kept in blocks of the allocator, so reclamation never calls
+`malloc`, and freed nodes go straight back to the allocator to be reused.
+
+The epoch is advanced by `ebrRetire` whenever a limbo list needs another block,
+and by `ebrCollect`, which threads that rarely retire can call from time to
+time. A thread that stays inside a critical section holds back the epoch, and
+with it the freeing of all nodes retired since; critical sections should be
+short.
+
+Blocks must be large enough to hold two pointers. Limbo lists hold one pointer
+less than fits in a block per block of the list.
+
+This library requires the `__atomic` builtins of GCC or Clang.
+
+LICENSE
+
+See end of file for license information.
+
+*/
+
+#ifndef EBR_INCLUDE_EPOCH_RECLAMATION_H
+#define EBR_INCLUDE_EPOCH_RECLAMATION_H
+
+#include <stddef.h>
+
+#include "fixed_size_block_allocator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef EBR_MAX_THREADS
+/*! @brief The most threads that can be registered with a domain at once. */
+#define EBR_MAX_THREADS 64
+#endif
+
+/* every thread announces its epoch on a cache line of its own */
+#define EBR_CACHE_LINE_SIZE 64
+
+/*! @brief Shared state of the threads reclaiming blocks of one allocator.
+ *  
+ *  Shared state of the threads reclaiming blocks of one allocator. Its members
+ *  are for internal use only; it is a complete type so that it can be given
+ *  static or automatic storage duration.
+ */
+typedef struct EbrDomain {
+    FsbaAllocator* pAllocator;
+    size_t batchSize;
+    unsigned long epoch;
+    unsigned slotCount;
+    char padding[EBR_CACHE_LINE_SIZE]; /* keeps the epoch off the line of the first slot */
+    struct {
+        unsigned long state;
+        char padding[EBR_CACHE_LINE_SIZE - sizeof(unsigned long)];
+    } slots[EBR_MAX_THREADS];
+} EbrDomain;
+
+/*! @brief State of one thread of a domain.
+ *  
+ *  State of one thread of a domain. Its members are for internal use only; it
+ *  is a complete type so that it can be given static, thread or automatic
+ *  storage duration.
+ */
+typedef struct EbrThread {
+    EbrDomain* pDomain;
+    unsigned slot;
+    unsigned long nesting;
+    struct {
+        unsigned long epoch;
+        void** pBatch;
+        size_t count;
+    } limbo[3];
+} EbrThread;
+
+/*! @brief Initializes a domain.
+ *  
+ *  @param[out] pDomain The domain to initialize.
+ *  
+ *  @param[in] pAllocator Handle to the atomic allocator whose blocks are
+ *  reclaimed.
+ *  
+ *  @return Nonzero on success, or zero if the blocks of the allocator are too
+ *  small to hold two pointers.
+ */
+int ebrInitDomain(EbrDomain* pDomain, FsbaAllocator* pAllocator);
+
+/*! @brief Registers a thread with a domain.
+ *  
+ *  This function adds a thread to a domain, and must be called by every thread
+ *  before it uses any other function with the domain. Each registered thread
+ *  takes one of `EBR_MAX_THREADS` slots of the domain until it unregisters.
+ *  
+ *  @param[in] pDomain The domain to register with.
+ *  
+ *  @param[out] pThread The state of the calling thread.
+ *  
+ *  @return Nonzero on success, or zero if all slots of the domain are taken.
+ */
+int ebrRegisterThread(EbrDomain* pDomain, EbrThread* pThread);
+
+/*! @brief Unregisters a thread from a domain.
+ *  
+ *  This function frees all blocks the thread has retired, waiting for other
+ *  threads to leave their critical sections if needed to do so, and gives up
+ *  the thread's slot. It must not be called inside a critical section. The
+ *  thread object may then be discarded.
+ *  
+ *  @param[in] pThread The state of the calling thread.
+ */
+void ebrUnregisterThread(EbrThread* pThread);
+
+/*! @brief Enters a critical section.
+ *  
+ *  This function makes sure that no block retired after it returns is freed
+ *  before the matching `ebrLeave`. Critical sections may be nested.
+ *  
+ *  @param[in] pThread The state of the calling thread.
+ */
+void ebrEnter(EbrThread* pThread);
+
+/*! @brief Leaves a critical section.
+ *  
+ *  @param[in] pThread The state of the calling thread.
+ */
+void ebrLeave(EbrThread* pThread);
+
+/*! @brief Retires a block.
+ *  
+ *  This function frees a block once no thread can be reading it anymore. The
+ *  block must already be unreachable for threads that enter a critical section
+ *  from now on. It is not written to until it is freed.
+ *  
+ *  @param[in] pThread The state of the calling thread.
+ *  
+ *  @param[in] pBlock Pointer to the block, or `NULL`. This must have been
+ *  previously returned by the allocator of the domain.
+ *  
+ *  @return Nonzero if the block was retired, or zero if the allocator is out
+ *  of memory for the limbo list even after freeing what could be freed. The
+ *  block then still belongs to the caller, who may try again later, best
+ *  outside of a critical section, as those hold back freeing.
+ */
+int ebrRetire(EbrThread* pThread, void* pBlock);
+
+/*! @brief Frees the retired blocks that are safe to free.
+ *  
+ *  This function tries to advance the epoch, and frees all blocks retired by
+ *  the calling thread that can no longer be seen.
+ *  
+ *  @param[in] pThread The state of the calling thread.
+ */
+void ebrCollect(EbrThread* pThread);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EBR_INCLUDE_EPOCH_RECLAMATION_H */
+
+
+
+#if defined(EPOCH_RECLAMATION_IMPLEMENTATION) && !defined(EPOCH_RECLAMATION_IMPLEMENTATION_INCLUDED)
+#define EPOCH_RECLAMATION_IMPLEMENTATION_INCLUDED
+
+#ifndef FSBA_ATOMIC
+#error "epoch_reclamation.h requires FSBA_ATOMIC"
+#endif
+
+/*  The state of a slot is 0 while it is free. A taken slot holds the epoch of
+ *  its thread shifted left by two, with `EBR_ACTIVE` set while the thread is
+ *  inside a critical section. Epochs are only ever compared for equality or
+ *  subtracted, so they may wrap around.
+ */
+#define EBR_ACTIVE 1UL
+#define EBR_TAKEN 2UL
+#define EBR_EPOCH_MASK (~0UL >> 2)
+
+/*  A batch is a block of the allocator: a link to the next batch, followed by
+ *  retired blocks. Only the first batch of a limbo list may be partly filled.
+ */
+
+int ebrInitDomain(EbrDomain* pDomain, FsbaAllocator* pAllocator)
+{
+    unsigned i;
+    
+    pDomain->pAllocator = pAllocator;
+    pDomain->batchSize = fsbaBlockSize(pAllocator) / sizeof(void*) - 1;
+    pDomain->epoch = 0;
+    pDomain->slotCount = 0;
+    for (i = 0; i < EBR_MAX_THREADS; ++i) pDomain->slots[i].state = 0;
+    return pDomain->batchSize != 0;
+}
+
+int ebrRegisterThread(EbrDomain* pDomain, EbrThread* pThread)
+{
+    unsigned long expected;
+    unsigned slot, count;
+    int i;
+    
+    pThread->pDomain = pDomain;
+    pThread->nesting = 0;
+    for (i = 0; i < 3; ++i) {
+        pThread->limbo[i].pBatch = NULL;
+        pThread->limbo[i].count = 0;
+    }
+    
+    for (slot = 0; slot < EBR_MAX_THREADS; ++slot) {
+        expected = 0;
+        if (__atomic_compare_exchange_n(
+                &pDomain->slots[slot].state,
+                &expected,
+                EBR_TAKEN,
+                0,
+                __ATOMIC_ACQ_REL,
+                __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    if (slot == EBR_MAX_THREADS) return 0;
+    pThread->slot = slot;
+    
+    /* scans stop at the highest slot ever taken */
+    count = __atomic_load_n(&pDomain->slotCount, __ATOMIC_RELAXED);
+    while (count < slot + 1 && !__atomic_compare_exchange_n(
+                &pDomain->slotCount,
+                &count,
+                slot + 1,
+                1,
+                __ATOMIC_RELEASE,
+                __ATOMIC_RELAXED)) {
+    }
+    return 1;
+}
+
+void ebrEnter(EbrThread* pThread)
+{
+    unsigned long epoch;
+    
+    if (pThread->nesting++ != 0) return;
+    
+    /*  The fence orders the announcement before any read of the data
+     *  structure, so that whoever advances the epoch either sees this thread
+     *  active or has its unlinks seen by it.
+     */
+    epoch = __atomic_load_n(&pThread->pDomain->epoch, __ATOMIC_RELAXED);
+    __atomic_store_n(
+        &pThread->pDomain->slots[pThread->slot].state,
+        (epoch << 2) | EBR_TAKEN | EBR_ACTIVE,
+        __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void ebrLeave(EbrThread* pThread)
+{
+    if (--pThread->nesting != 0) return;
+    __atomic_store_n(&pThread->pDomain->slots[pThread->slot].state, EBR_TAKEN, __ATOMIC_RELEASE);
+}
+
+/* advances the epoch if every active thread has seen it, and returns the epoch */
+static unsigned long ebr_tryAdvance(EbrDomain* pDomain)
+{
+    unsigned long epoch = __atomic_load_n(&pDomain->epoch, __ATOMIC_SEQ_CST);
+    unsigned long state;
+    unsigned slot, count;
+    
+    count = __atomic_load_n(&pDomain->slotCount, __ATOMIC_ACQUIRE);
+    
+    /*  The fence pairs with the one in `ebrEnter`: either the scan sees a
+     *  thread's announcement, or that thread sees the retirements made before
+     *  this call and none of the blocks they unlinked.
+     */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for (slot = 0; slot < count; ++slot) {
+        state = __atomic_load_n(&pDomain->slots[slot].state, __ATOMIC_ACQUIRE);
+        if ((state & EBR_ACTIVE) && (state >> 2) != (epoch & EBR_EPOCH_MASK)) return epoch;
+    }
+    
+    /* a failed exchange means another thread advanced it already */
+    __atomic_compare_exchange_n(
+        &pDomain->epoch, &epoch, epoch + 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    return __atomic_load_n(&pDomain->epoch, __ATOMIC_ACQUIRE);
+}
+
+static void ebr_freeLimbo(EbrThread* pThread, int i)
+{
+    FsbaAllocator* pAllocator = pThread->pDomain->pAllocator;
+    void** pBatch = pThread->limbo[i].pBatch;
+    void** pNext;
+    size_t count = pThread->limbo[i].count;
+    
+    while (pBatch != NULL) {
+        pNext = (void**)pBatch[0];
+        fsbaFreeN(pAllocator, pBatch + 1, count);
+        fsbaFree(pAllocator, pBatch);
+        pBatch = pNext;
+        count = pThread->pDomain->batchSize;
+    }
+    pThread->limbo[i].pBatch = NULL;
+    pThread->limbo[i].count = 0;
+}
+
+/* frees the limbo lists of epochs at least two behind `epoch` */
+static void ebr_freeOldLimbo(EbrThread* pThread, unsigned long epoch)
+{
+    int i;
+    
+    for (i = 0; i < 3; ++i) {
+        if (pThread->limbo[i].pBatch != NULL && epoch - pThread->limbo[i].epoch >= 2) {
+            ebr_freeLimbo(pThread, i);
+        }
+    }
+}
+
+int ebrRetire(EbrThread* pThread, void* pBlock)
+{
+    EbrDomain* pDomain = pThread->pDomain;
+    unsigned long epoch;
+    void** pBatch;
+    int i;
+    
+    if (pBlock == NULL) return 1;
+    
+    /* the caller's unlink must come before the epoch is read */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    epoch = __atomic_load_n(&pDomain->epoch, __ATOMIC_RELAXED);
+    
+    /* a list left over from three epochs ago can go before the list is reused */
+    i = (int)(epoch % 3);
+    if (pThread->limbo[i].pBatch != NULL && pThread->limbo[i].epoch != epoch) {
+        ebr_freeLimbo(pThread, i);
+    }
+    
+    if (pThread->limbo[i].pBatch == NULL || pThread->limbo[i].count == pDomain->batchSize) {
+        /*  A good time to move the epoch on, as it happens once per batch.
+         *  Waiting for memory here could wait forever, as the caller may be
+         *  inside a critical section and hold back the epoch itself.
+         */
+        ebr_freeOldLimbo(pThread, ebr_tryAdvance(pDomain));
+        pBatch = (void**)fsbaAllocate(pDomain->pAllocator);
+        if (pBatch == NULL) return 0;
+        pBatch[0] = pThread->limbo[i].pBatch;
+        pThread->limbo[i].pBatch = pBatch;
+        pThread->limbo[i].count = 0;
+    }
+    pThread->limbo[i].epoch = epoch;
+    pThread->limbo[i].pBatch[1 + pThread->limbo[i].count++] = pBlock;
+    return 1;
+}
+
+void ebrCollect(EbrThread* pThread)
+{
+    ebr_freeOldLimbo(pThread, ebr_tryAdvance(pThread->pDomain));
+}
+
+void ebrUnregisterThread(EbrThread* pThread)
+{
+    while (pThread->limbo[0].pBatch != NULL
+            || pThread->limbo[1].pBatch != NULL
+            || pThread->limbo[2].pBatch != NULL) {
+        ebrCollect(pThread);
+    }
+    __atomic_store_n(&pThread->pDomain->slots[pThread->slot].state, 0UL, __ATOMIC_RELEASE);
+}
+
+#undef EBR_ACTIVE
+#undef EBR_TAKEN
+#undef EBR_EPOCH_MASK
+
+#endif /* EPOCH_RECLAMATION_IMPLEMENTATION */
+
+/*
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+
+*/
@@ -34,6 +34,116 @@ Once you are done using the allocator, simply take care of the memory that was
 passed to `fsbaEmplaceAllocator`. If this memory has static or automatic
 storage duration, nothing needs to be done.
 
+Freed blocks are handed out again last freed, first allocated, which keeps
+them warm in the cache. After a long run of mixed allocating and freeing,
+however, consecutive allocations land all over the memory. `fsbaSortFreeList`
+puts the free blocks back in address order, so that objects allocated together
+share cache lines and pages again; it can be called at quiet moments, such as
+between frames or requests.
+
+By default, an allocator must not be used by several threads at once. If
+`FSBA_ATOMIC` is defined wherever this file is included, one allocator can be
+shared by any number of threads without a mutex. `fsbaFree` is then lock-free,
+and so is `fsbaAllocate` unless `fsbaSortFreeList` is running: an allocation
+that finds neither free blocks nor fresh memory while a sort holds the free
+list waits for the sort, spinning and then yielding the processor:
+
+    #define FSBA_ATOMIC
+    #define FSBA_IMPLEMENTATION
+    #include "fixed_size_block_allocator.h"
+
+This requires the `__atomic` builtins of GCC or Clang. The free list is then a
+stack of 32-bit block indices whose head carries a 32-bit tag against the ABA
+problem, and fresh blocks are claimed from the rest of the memory with a single
+atomic add. An atomic allocator holds at most 2^32 - 2 blocks.
+
+An atomic allocator stores no pointers, so it also works in memory shared
+between processes, even where the memory is mapped at different addresses.
+One process emplaces the allocator at the start of the shared memory, and the
+others find it there with `fsbaAttachAllocator`:
+
+    void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    FsbaAllocator* allocator = fsbaAttachAllocator(mem);
+
+Pointers to blocks are only meaningful within one process; pass blocks between
+processes by the indices returned by `fsbaIndexOf`, and turn them back into
+pointers with `fsbaAt`.
+
+When many threads allocate and free at a high rate, even a lock-free allocator
+spends its time bouncing the cache line that holds the free list. An atomic
+allocator can then be fronted by one `FsbaCache` per thread:
+
+    static _Thread_local FsbaCache cache;
+    fsbaInitCache(&cache, allocator, 32);
+    
+    MyObjectType* obj = fsbaCacheAllocate(&cache);
+    fsbaCacheFree(&cache, obj);
+    
+    fsbaFlushCache(&cache);
+
+A cache holds up to two magazines of free blocks, and only touches the shared
+allocator to swap a whole magazine for a full or an empty one.
+
+If blocks are allocated by one thread, the owner, but freed by others, define
+`FSBA_REMOTE_FREE` instead. The owner then keeps calling `fsbaAllocate` and
+`fsbaFree` without any synchronization, while other threads return blocks with
+`fsbaFreeRemote`. Remote frees are pushed onto a separate lock-free list, which
+the owner takes over as a whole once its own free list runs empty. This too
+requires the `__atomic` builtins of GCC or Clang. If `FSBA_ATOMIC` is also
+defined, `fsbaFreeRemote` is the same as `fsbaFree`.
+
+`FsbaAllocator` keeps its free list inside the free blocks themselves, so every
+block is at least as large as a pointer, and freeing a block writes to it. A
+`FsbaBitmapAllocator` instead keeps one bit per block in a bitmap placed in
+front of the blocks:
+
+    FsbaBitmapAllocator* bitmap = fsbaEmplaceBitmapAllocator(
+        mem, sizeof mem, sizeof(short), alignof(short), NULL);
+    short* obj = fsbaBitmapAllocate(bitmap);
+    fsbaBitmapFree(bitmap, obj);
+
+Blocks may be smaller than a pointer, freed blocks are never touched, and the
+allocated blocks can be visited in address order:
+
+    for (obj = fsbaBitmapNext(bitmap, NULL); obj; obj = fsbaBitmapNext(bitmap, obj))
+        ...
+
+Since freed blocks are never touched, pages whose blocks have all been freed
+can be handed back to the system, and are backed again on their next use. With
+page_memory.h:
+
+    fsbaBitmapSetPageRelease(bitmap, pmPageSize(), pmRelease);
+
+    fsbaBitmapReleaseFreePages(bitmap);
+
+Pages are only handed back by `fsbaBitmapReleaseFreePages`, never by freeing,
+so that a block freed and allocated again over and over does not cost a system
+call and a page fault every time. Call it from a timer, or after a burst of
+frees.
+
+Free blocks are found a word of the bitmap at a time, by counting trailing
+zeros. `FSBA_ATOMIC` and `FSBA_REMOTE_FREE` do not affect bitmap allocators,
+which must not be used by several threads at once.
+
+Blocks whose size is a power of two, or another even multiple of the cache line
+size, all start in the same few sets of the cache, and walking many of them
+keeps evicting one another. If `FSBA_CACHE_COLORING` is defined where
+`FSBA_IMPLEMENTATION` is, such blocks are padded by one cache line, so that
+each starts one line further into its page than the one before. Only blocks
+of at least `FSBA_CACHE_COLORING_MIN` bytes, 512 by default, are padded:
+smaller ones already spread over many sets, and a line would cost them too
+much. With the default `FSBA_CACHE_LINE_SIZE` of 64 bytes, padding adds 12.5%
+to blocks of 512 bytes, 6.25% to blocks of 1024, 3.1% to blocks of 2048 and
+1.6% to blocks of 4096; blocks that are an odd number of lines are left alone.
+
+Allocations and frees can be reported to a profiler, such as heap_profiler.h,
+by defining `FSBA_ON_ALLOCATE(pAllocator, pBlock, size)`,
+`FSBA_ON_FREE(pAllocator, pBlock)`, `FSBA_ON_RESET(pAllocator)` and
+`FSBA_ON_RELEASE(pAllocator, pBegin, pEnd)` where `FSBA_IMPLEMENTATION` is.
+They cover `fsbaAllocate`, `fsbaAllocateN`, the caches and all ways of freeing;
+`fsbaRelease` reports the blocks it frees as address ranges, as blocks below
+the marker stay allocated. By default, they expand to nothing.
+
 More detailed documentation follows.
 
 LICENSE
@@ -47,6 +157,10 @@ See end of file for license information.
 
 #include <stddef.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /*! @brief Opaque allocator object.
  *  
  *  Opaque allocator object.
@@ -114,6 +228,201 @@ void* fsbaAllocate(FsbaAllocator* pAllocator);
  */
 void fsbaFree(FsbaAllocator* pAllocator, void* pBlock);
 
+#ifndef FSBA_ATOMIC
+
+/*! @brief Gives an allocator more memory.
+ *  
+ *  This function attaches another region of memory to an allocator, so that it
+ *  can keep allocating without being emplaced again. Once the allocator has
+ *  handed out all fresh blocks of its current region, it moves on to the
+ *  regions attached to it, in the order they were attached. Blocks from any
+ *  region are freed with `fsbaFree` as usual.
+ *  
+ *  The caller is responsible for the memory passed to this function, and must
+ *  keep it around for as long as the allocator is used.
+ *  
+ *  @param[in] pAllocator Handle to the allocator to give the memory to.
+ *  
+ *  @param[in] pMem Pointer to the memory to be used by the allocator.
+ *  
+ *  @param[in] memSize The size of the memory pointed to by `pMem`.
+ *  
+ *  @return The number of blocks the memory added to the allocator, or 0 if it
+ *  was too small to hold a single block, in which case it is not used.
+ *  
+ *  @remarks Not available with `FSBA_ATOMIC`, whose free list links blocks by
+ *  their index within a single region.
+ */
+size_t fsbaAddMemory(FsbaAllocator* pAllocator, void* pMem, size_t memSize);
+
+#endif /* FSBA_ATOMIC */
+
+/*! @brief Allocates several memory blocks at once.
+ *  
+ *  This function allocates up to `count` memory blocks, as if by calling
+ *  `fsbaAllocate` that many times, but faster: fresh blocks are taken as a
+ *  single run from the rest of the memory.
+ *  
+ *  @param[in] pAllocator Handle to the allocator from which to request the
+ *  memory blocks.
+ *  
+ *  @param[out] ppBlocks Where to store the pointers to the memory blocks.
+ *  
+ *  @param[in] count The number of memory blocks to allocate.
+ *  
+ *  @return The number of memory blocks allocated, which is less than `count`
+ *  only if the allocator ran out of memory.
+ */
+size_t fsbaAllocateN(FsbaAllocator* pAllocator, void** ppBlocks, size_t count);
+
+/*! @brief Frees several memory blocks at once.
+ *  
+ *  This function frees memory blocks as if by calling `fsbaFree` on each of
+ *  them, but faster: the blocks are linked together first, and then added to
+ *  the free list with a single update. Blocks are handed out again in the
+ *  order they are given in.
+ *  
+ *  @param[in] pAllocator Handle to the allocator from which the memory blocks
+ *  were previously requested.
+ *  
+ *  @param[in] ppBlocks Pointers to the memory blocks to be freed. Each of them
+ *  must have been previously returned by the same allocator, or be `NULL`.
+ *  
+ *  @param[in] count The number of pointers in `ppBlocks`.
+ */
+void fsbaFreeN(FsbaAllocator* pAllocator, void** ppBlocks, size_t count);
+
+/*! @brief Sorts the free list by address.
+ *  
+ *  This function reorders the free blocks of an allocator so that they are
+ *  handed out lowest address first. After much allocating and freeing, the
+ *  free list hands out blocks from all over the memory; once it is sorted,
+ *  blocks allocated one after another lie next to each other again, sharing
+ *  cache lines and pages with each other rather than with unrelated blocks.
+ *  Free blocks right below the fresh memory of the allocator are given back
+ *  to it, though never below the position saved by the latest call to
+ *  `fsbaMark`, so that `fsbaRelease` still frees every block handed out past
+ *  it.
+ *  
+ *  The list is merge sorted in place, in O(n log n) time for n free blocks.
+ *  
+ *  @param[in] pAllocator Handle to the allocator.
+ *  
+ *  @remarks With `FSBA_ATOMIC`, other threads may keep allocating and freeing
+ *  while the list is sorted, as on a background thread, but not call
+ *  `fsbaMark`. Blocks they free in the meantime are handed out before the
+ *  sorted ones. Their allocations take fresh memory while the sorted blocks
+ *  are held, and wait for the sort only once it has run out. Such a wait
+ *  lasts as long as the sort, so it is not lock-free: a sorting thread that
+ *  is descheduled holds them up.
+ */
+void fsbaSortFreeList(FsbaAllocator* pAllocator);
+
+/*! @brief Tells whether a pointer points into an allocator's memory.
+ *  
+ *  This function tells whether a pointer points into the memory from which an
+ *  allocator hands out blocks, so that a block can be routed back to the
+ *  allocator it came from. It takes constant time, plus a step for every
+ *  region added with `fsbaAddMemory` that has to be looked at.
+ *  
+ *  @param[in] pAllocator Handle to the allocator.
+ *  
+ *  @param[in] ptr The pointer to look up.
+ *  
+ *  @return Nonzero if `ptr` points into the allocator's memory, 0 otherwise.
+ */
+int fsbaOwns(const FsbaAllocator* pAllocator, const void* ptr);
+
+/*! @brief Returns the index of a memory block.
+ *  
+ *  This function maps a memory block to its index. Blocks are numbered densely
+ *  from 0, in address order within each region and in the order regions were
+ *  added, so an index may be stored in fewer bits than a pointer. Like
+ *  `fsbaOwns`, it takes constant time plus a step per added region looked at.
+ *  
+ *  @param[in] pAllocator Handle to the allocator.
+ *  
+ *  @param[in] pBlock Pointer to a memory block returned by the allocator.
+ *  
+ *  @return The index of the memory block.
+ */
+size_t fsbaIndexOf(const FsbaAllocator* pAllocator, const void* pBlock);
+
+/*! @brief Returns the memory block with the given index.
+ *  
+ *  This function is the inverse of `fsbaIndexOf`.
+ *  
+ *  @param[in] pAllocator Handle to the allocator.
+ *  
+ *  @param[in] index The index of a memory block, as returned by
+ *  `fsbaIndexOf`.
+ *  
+ *  @return A pointer to the memory block.
+ */
+void* fsbaAt(const FsbaAllocator* pAllocator, size_t index);
+
+/*! @brief Saved position of an allocator, see `fsbaMark`.
+ *  
+ *  Saved position of an allocator. Its members are for internal use only.
+ */
+typedef struct FsbaMarker {
+    void* pRegion;
+    size_t offset;
+} FsbaMarker;
+
+/*! @brief Frees all memory blocks at once.
+ *  
+ *  This function returns an allocator to the state it was in right after it
+ *  was emplaced, in constant time, no matter how many blocks are allocated.
+ *  Memory added with `fsbaAddMemory` stays with the allocator. All blocks
+ *  previously returned by the allocator become invalid.
+ *  
+ *  @param[in] pAllocator Handle to the allocator to reset.
+ *  
+ *  @remarks No other thread may use the allocator during the call. With
+ *  `FSBA_ATOMIC`, every `FsbaCache` of the allocator must be initialized
+ *  again with `fsbaInitCache` afterwards.
+ */
+void fsbaReset(FsbaAllocator* pAllocator);
+
+/*! @brief Saves the position of an allocator.
+ *  
+ *  This function saves how far into its memory an allocator has handed out
+ *  fresh blocks, so that `fsbaRelease` can later free all blocks handed out
+ *  past that point at once, arena-style. The allocator keeps the latest
+ *  position too, so that `fsbaSortFreeList` does not move its fresh memory
+ *  back below it.
+ *  
+ *  @param[in] pAllocator Handle to the allocator whose position to save.
+ *  
+ *  @return The saved position.
+ */
+FsbaMarker fsbaMark(FsbaAllocator* pAllocator);
+
+/*! @brief Rolls an allocator back to a saved position.
+ *  
+ *  This function frees every fresh block handed out since the call to
+ *  `fsbaMark` that returned `marker`, by moving the fresh memory back to the
+ *  marker. Blocks on the free list that lie past the marker are dropped from
+ *  it, as they are part of the memory handed back, while those below it stay
+ *  on it; this takes time proportional to the length of the free list.
+ *  Blocks taken off the free list since the marker lie below it and are not
+ *  freed: they stay allocated until they are passed to `fsbaFree`.
+ *  Allocating from a marker with no interleaved `fsbaFree`, then releasing
+ *  it, is the intended use.
+ *  
+ *  @param[in] pAllocator Handle to the allocator to roll back.
+ *  
+ *  @param[in] marker A position saved from the same allocator, not since
+ *  invalidated by `fsbaReset` or by releasing an earlier marker.
+ *  
+ *  @remarks No other thread may use the allocator during the call. With
+ *  `FSBA_ATOMIC`, every `FsbaCache` of the allocator must be flushed with
+ *  `fsbaFlushCache` before the call, or else initialized again with
+ *  `fsbaInitCache` afterwards, which loses the free blocks it held.
+ */
+void fsbaRelease(FsbaAllocator* pAllocator, FsbaMarker marker);
+
 /*! @brief Returns the size of an allocator.
  *  
  *  This function returns the size of an allocator object. Can be good to know
@@ -132,19 +441,380 @@ size_t fsbaAllocatorSize(void);
  */
 size_t fsbaAllocatorAlignment(void);
 
+/*! @brief Returns the memory needed for a number of blocks.
+ *  
+ *  This function returns a memory size for which `fsbaEmplaceAllocator` is
+ *  sure to make room for at least the given number of blocks, wherever the
+ *  memory is placed.
+ *  
+ *  @param[in] blockCount The number of blocks.
+ *  
+ *  @param[in] blockSize The fixed size of the memory blocks.
+ *  
+ *  @param[in] blockAlign The alignment requirement of the memory blocks.
+ *  
+ *  @return The size of the memory to pass to `fsbaEmplaceAllocator`.
+ */
+size_t fsbaMemorySize(size_t blockCount, size_t blockSize, size_t blockAlign);
+
+/*! @brief Returns the block size of an allocator.
+ *  
+ *  This function returns the distance between two neighboring blocks, which is
+ *  the block size that was requested, rounded up to the block alignment and to
+ *  the size of a pointer, and padded by a cache line with
+ *  `FSBA_CACHE_COLORING` if it is an even number of lines of at least
+ *  `FSBA_CACHE_COLORING_MIN` bytes.
+ *  
+ *  @param[in] pAllocator Handle to the allocator.
+ *  
+ *  @return The number of bytes that may be used in every block.
+ */
+size_t fsbaBlockSize(const FsbaAllocator* pAllocator);
+
+/*! @brief Opaque bitmap allocator object.
+ *  
+ *  Opaque bitmap allocator object.
+ */
+typedef struct FsbaBitmapAllocator FsbaBitmapAllocator;
+
+/*! @brief Emplaces a bitmap allocator in the given memory.
+ *  
+ *  This function constructs a bitmap allocator in-place within the memory
+ *  passed to it, like `fsbaEmplaceAllocator` does. The rest of the memory
+ *  holds a bitmap with one bit per block, followed by the blocks.
+ *  
+ *  @param[in] pMem Pointer to the memory to be used by the allocator.
+ *  
+ *  @param[in] memSize The size of the memory pointed to by `pMem`.
+ *  
+ *  @param[in] blockSize The fixed size of the memory blocks to be allocated.
+ *  Unlike with `fsbaEmplaceAllocator`, it may be smaller than a pointer.
+ *  
+ *  @param[in] blockAlign The alignment requirement of the memory blocks.
+ *  
+ *  @param[out] pBlockCount Where to store the maximum number of blocks that
+ *  can be allocated at once, or `NULL`.
+ *  
+ *  @return A handle to the allocator, or `NULL` if not given enough memory.
+ */
+FsbaBitmapAllocator* fsbaEmplaceBitmapAllocator(
+    void* pMem,
+    size_t memSize,
+    size_t blockSize,
+    size_t blockAlign,
+    size_t* pBlockCount);
+
+/*! @brief Allocates a memory block from a bitmap allocator.
+ *  
+ *  This function allocates the free memory block with the lowest address.
+ *  
+ *  @param[in] pAllocator Handle to the allocator from which to request the
+ *  memory block.
+ *  
+ *  @return A pointer to the memory block, or `NULL` if the allocator is out of
+ *  memory.
+ */
+void* fsbaBitmapAllocate(FsbaBitmapAllocator* pAllocator);
+
+/*! @brief Frees a memory block of a bitmap allocator.
+ *  
+ *  This function frees a memory block that has previously been returned by a
+ *  call to `fsbaBitmapAllocate`. Only the bitmap is written to.
+ *  
+ *  @param[in] pAllocator Handle to the allocator from which the memory block
+ *  was previously requested.
+ *  
+ *  @param[in] pBlock Pointer to the memory block to be freed, or `NULL`.
+ *  This must have been previously returned by a call to `fsbaBitmapAllocate`,
+ *  using the same allocator.
+ */
+void fsbaBitmapFree(FsbaBitmapAllocator* pAllocator, void* pBlock);
+
+/*! @brief Iterates over the allocated blocks of a bitmap allocator.
+ *  
+ *  This function returns the allocated memory block that follows a given
+ *  block in address order. Freeing the block just returned does not disturb
+ *  the iteration.
+ *  
+ *  @param[in] pAllocator Handle to the allocator.
+ *  
+ *  @param[in] pBlock A memory block of the allocator, or `NULL` to get the
+ *  first allocated block.
+ *  
+ *  @return A pointer to the next allocated memory block, or `NULL` if there
+ *  is none.
+ */
+void* fsbaBitmapNext(const FsbaBitmapAllocator* pAllocator, const void* pBlock);
+
+/*! @brief Sets how a bitmap allocator hands back pages that are free.
+ *  
+ *  This function sets the function that `fsbaBitmapReleaseFreePages` calls
+ *  with runs of pages on which every block is free. The function may drop the
+ *  contents of the pages, for instance with `madvise(MADV_DONTNEED)`, as long
+ *  as they can still be written to.
+ *  
+ *  @param[in] pAllocator Handle to the allocator.
+ *  
+ *  @param[in] pageSize The size of a page, a power of two.
+ *  
+ *  @param[in] pfnRelease The function to call with the address and size of
+ *  free pages, or `NULL` to stop handing back pages.
+ */
+void fsbaBitmapSetPageRelease(
+    FsbaBitmapAllocator* pAllocator,
+    size_t pageSize,
+    void (*pfnRelease)(void* pPages, size_t size));
+
+/*! @brief Hands back the pages of a bitmap allocator that are free.
+ *  
+ *  This function calls the function set with `fsbaBitmapSetPageRelease` once
+ *  for every run of pages on which every block is free. Freeing a block never
+ *  hands back its pages by itself, so this is meant to be called from a timer
+ *  or after a burst of frees. Only pages under the blocks freed since the last
+ *  call are looked at. As blocks are allocated lowest address first,
+ *  pages at the end of the memory are the ones that stay released under a
+ *  varying load.
+ *  
+ *  @param[in] pAllocator Handle to the allocator.
+ *  
+ *  @return The number of bytes handed back, or 0 if no function is set.
+ */
+size_t fsbaBitmapReleaseFreePages(FsbaBitmapAllocator* pAllocator);
+
+#ifdef FSBA_REMOTE_FREE
+
+/*! @brief Frees a memory block from a thread that does not own the allocator.
+ *  
+ *  This function frees a memory block that has previously been returned by a
+ *  call to `fsbaAllocate`, and may be called by any thread while the owner of
+ *  the allocator is using it. The block becomes available to `fsbaAllocate`
+ *  once the owner's free list runs empty.
+ *  
+ *  @param[in] pAllocator Handle to the allocator from which the memory block
+ *  was previously requested.
+ *  
+ *  @param[in] pBlock Pointer to the memory block to be freed.
+ *  This must have been previously returned by a call to `fsbaAllocate`, using
+ *  the same allocator.
+ */
+void fsbaFreeRemote(FsbaAllocator* pAllocator, void* pBlock);
+
+#endif /* FSBA_REMOTE_FREE */
+
+#ifdef FSBA_ATOMIC
+
+/*! @brief Finds an allocator emplaced in the given memory.
+ *  
+ *  This function returns the handle of an allocator that was emplaced in the
+ *  same memory, possibly by another process and at another address, with
+ *  `fsbaEmplaceAllocator`. The memory must be mapped at an address aligned at
+ *  least as strictly as it was when the allocator was emplaced; page-aligned
+ *  mappings always are.
+ *  
+ *  @param[in] pMem Pointer to the memory that was passed to
+ *  `fsbaEmplaceAllocator`.
+ *  
+ *  @return A handle to the allocator.
+ *  
+ *  @remarks Only available with `FSBA_ATOMIC`.
+ */
+FsbaAllocator* fsbaAttachAllocator(void* pMem);
+
+/*! @brief Thread-local cache in front of an atomic allocator.
+ *  
+ *  Thread-local cache in front of an atomic allocator. Its members are for
+ *  internal use only; it is a complete type so that it can be given static,
+ *  thread or automatic storage duration.
+ */
+typedef struct FsbaCache {
+    FsbaAllocator* pAllocator;
+    size_t magazineSize;
+    struct {
+        unsigned int first;
+        unsigned int last;
+        size_t count;
+    } loaded, previous;
+} FsbaCache;
+
+/*! @brief Initializes a thread-local cache.
+ *  
+ *  This function initializes an empty cache in front of an allocator. A cache
+ *  must only ever be used by one thread at a time, while any number of caches
+ *  may share the same allocator.
+ *  
+ *  @param[out] pCache The cache to initialize.
+ *  
+ *  @param[in] pAllocator Handle to the allocator to be cached.
+ *  
+ *  @param[in] magazineSize The number of blocks exchanged with the allocator at
+ *  once. The cache holds at most twice that many free blocks. Must not be 0.
+ */
+void fsbaInitCache(
+    FsbaCache* pCache,
+    FsbaAllocator* pAllocator,
+    size_t magazineSize);
+
+/*! @brief Allocates a memory block through a cache.
+ *  
+ *  This function allocates a memory block from the cache, and refills the
+ *  cache with a magazine of blocks from its allocator when it is empty.
+ *  
+ *  @param[in] pCache The cache from which to request the memory block.
+ *  
+ *  @return A pointer to the memory block, or `NULL` if both the cache and the
+ *  allocator are out of memory.
+ */
+void* fsbaCacheAllocate(FsbaCache* pCache);
+
+/*! @brief Frees a memory block through a cache.
+ *  
+ *  This function returns a memory block to the cache, and hands a full
+ *  magazine of blocks back to the allocator when the cache is full.
+ *  
+ *  @param[in] pCache The cache to which to return the memory block.
+ *  
+ *  @param[in] pBlock Pointer to the memory block to be freed.
+ *  This must have been previously returned by the cached allocator, through
+ *  any cache or directly.
+ */
+void fsbaCacheFree(FsbaCache* pCache, void* pBlock);
+
+/*! @brief Empties a cache.
+ *  
+ *  This function returns all blocks held by a cache to its allocator. Call it
+ *  before a thread that owns a cache exits, or the blocks it holds are lost.
+ *  
+ *  @param[in] pCache The cache to empty.
+ */
+void fsbaFlushCache(FsbaCache* pCache);
+
+#endif /* FSBA_ATOMIC */
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* FSBA_INCLUDE_FIXED_SIZE_BLOCK_ALLOCATOR_H */
 
 
 
-#ifdef FSBA_IMPLEMENTATION
+#if defined(FSBA_IMPLEMENTATION) && !defined(FSBA_IMPLEMENTATION_INCLUDED)
+#define FSBA_IMPLEMENTATION_INCLUDED
+
+#include <limits.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if (defined(FSBA_ATOMIC) || defined(FSBA_REMOTE_FREE)) && !defined(__GNUC__)
+#error "FSBA_ATOMIC and FSBA_REMOTE_FREE require the __atomic builtins of GCC or Clang"
+#endif
+
+#ifdef FSBA_ATOMIC
+/* waiting on a sort spins with a hint to the processor, then yields */
+#if defined(__i386__) || defined(__x86_64__)
+#define fsba_pause() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define fsba_pause() __asm__ __volatile__("yield")
+#else
+#define fsba_pause() ((void)0)
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <sched.h>
+#define fsba_yield() ((void)sched_yield())
+#else
+#define fsba_yield() ((void)0)
+#endif
+#define FSBA_MAX_SPINS 1024
+#endif
+
+/*  Hooks for profilers such as heap_profiler.h, which may be defined before
+ *  the implementation is included. A block is reported freed before it goes
+ *  back to the allocator, where another thread could allocate it again.
+ */
+#ifndef FSBA_ON_ALLOCATE
+#define FSBA_ON_ALLOCATE(pAllocator, pBlock, size) ((void)0)
+#endif
+#ifndef FSBA_ON_FREE
+#define FSBA_ON_FREE(pAllocator, pBlock) ((void)0)
+#endif
+#ifndef FSBA_ON_RESET
+#define FSBA_ON_RESET(pAllocator) ((void)0)
+#endif
+#ifndef FSBA_ON_RELEASE
+#define FSBA_ON_RELEASE(pAllocator, pBegin, pEnd) ((void)(pBegin), (void)(pEnd))
+#endif
+
+#ifndef FSBA_ATOMIC
+
+/*  Describes a region of block memory. The region the allocator was emplaced
+ *  in is described within the allocator; the header of every other region is
+ *  placed at the beginning of the memory given to `fsbaAddMemory`.
+ */
+struct fsba_Region {
+    struct fsba_Region* pNext;
+    char* pBlockMemBegin;
+    char* pBlockMemEnd;
+    size_t firstIndex; /* index of the first block of the region */
+};
 
 struct FsbaAllocator {
     char* pFreeMemBegin;
     char* pFreeMemEnd;
     size_t blockSize;
     void** pFreeBlock;
+#ifdef FSBA_REMOTE_FREE
+    void* pRemoteFreeBlock; /* pushed to atomically by other threads */
+#endif
+    struct fsba_Region* pRegion; /* the region `pFreeMemBegin` is in */
+    struct fsba_Region firstRegion;
+    size_t blockAlign;
+    FsbaMarker mark; /* the latest marker, which sorting never moves the fresh memory below */
+};
+
+#else /* FSBA_ATOMIC */
+
+/* anything short of lock-free would not work across processes */
+#if defined(__GCC_ATOMIC_LLONG_LOCK_FREE) && __GCC_ATOMIC_LLONG_LOCK_FREE < 2
+#error "FSBA_ATOMIC requires lock-free 64-bit atomics"
+#endif
+
+/*  The head of the free list packs the index of the first free block into its
+ *  low 32 bits and a tag into its high 32 bits. The tag changes on every
+ *  successful update, so a pop that read a stale head cannot succeed.
+ *  Free blocks hold the index of the next free block.
+ */
+__extension__ typedef unsigned long long fsba_Head;
+typedef unsigned int fsba_Index;
+
+#define FSBA_NO_BLOCK           ((fsba_Index)0xFFFFFFFF)
+#define fsba_headIndex(head)    ((fsba_Index)((head) & 0xFFFFFFFF))
+#define fsba_headTag(head)      ((fsba_Index)((head) >> 32))
+#define fsba_makeHead(index, tag) \
+    (((fsba_Head)(fsba_Index)(tag) << 32) | (fsba_Index)(index))
+
+/*  An atomic allocator holds no pointers, only offsets and indices, so that it
+ *  works from any address its memory is mapped at.
+ */
+struct FsbaAllocator {
+    size_t blockMemOffset;  /* offset of the first block from the allocator */
+    size_t freeMemBegin;    /* offset from the first block, bumped atomically */
+    size_t freeMemEnd;      /* offset from the first block */
+    size_t blockSize;
+    fsba_Head freeBlock;
+    size_t markOffset;      /* the latest marker, which sorting never moves `freeMemBegin` below */
+    unsigned sortCount;     /* sorts holding blocks taken off the free list */
+    unsigned sortsDone;     /* bumped whenever a sort hands its blocks back */
 };
 
+static char* fsba_blockMem(const FsbaAllocator* pAllocator)
+{
+    return (char*)pAllocator + pAllocator->blockMemOffset;
+}
+
+#endif /* FSBA_ATOMIC */
+
 #define fsba_alignof(type) offsetof(struct {char x; type y;}, y)
 
 static void* fsba_alignUp(void* ptr, size_t align)
@@ -178,6 +848,36 @@ static size_t fsba_LCM(size_t a, size_t b)
     return (a * b) / fsba_GCD(a, b);
 }
 
+#ifdef FSBA_CACHE_COLORING
+
+#ifndef FSBA_CACHE_LINE_SIZE
+#define FSBA_CACHE_LINE_SIZE 64
+#endif
+
+#ifndef FSBA_CACHE_COLORING_MIN
+#define FSBA_CACHE_COLORING_MIN 512
+#endif
+
+/*  Blocks whose size is an even number of cache lines only ever start in some
+ *  of the cache sets; blocks of 4096 bytes all start in the same one. One more
+ *  cache line makes the number odd, so that successive blocks start one line
+ *  further into their page each time, cycling through all of the sets. Blocks
+ *  aligned more strictly than a cache line cannot be staggered, and blocks of
+ *  128 or 256 bytes still start in a half or a quarter of the sets, which is
+ *  not worth a line each.
+ */
+static size_t fsba_colorBlockSize(size_t blockSize, size_t blockAlign)
+{
+    if (FSBA_CACHE_LINE_SIZE % blockAlign == 0
+            && blockSize >= FSBA_CACHE_COLORING_MIN
+            && blockSize % (2 * FSBA_CACHE_LINE_SIZE) == 0) {
+        blockSize += FSBA_CACHE_LINE_SIZE;
+    }
+    return blockSize;
+}
+
+#endif /* FSBA_CACHE_COLORING */
+
 FsbaAllocator* fsbaEmplaceAllocator(
     void* pMem,
     size_t memSize,
@@ -206,6 +906,9 @@ FsbaAllocator* fsbaEmplaceAllocator(
     /* blocks must be large enough to hold pointers */
     if (blockSize < sizeof(void*)) blockSize = sizeof(void*);
     blockSize = fsba_roundUp(blockSize, blockAlign);
+#ifdef FSBA_CACHE_COLORING
+    blockSize = fsba_colorBlockSize(blockSize, blockAlign);
+#endif
     
     /* block memory begins at first aligned address after the allocator */
     pBlockMemBegin = fsba_alignUp(pAllocator + 1, blockAlign);
@@ -216,13 +919,42 @@ FsbaAllocator* fsbaEmplaceAllocator(
     /* correct the size of the memory down to its effective size */
     memSize = fsba_roundDown(memSize - memUsed, blockSize);
     
+#ifdef FSBA_ATOMIC
+    /* blocks are linked by 32-bit indices, one of which means "none" */
+    if (memSize / blockSize > FSBA_NO_BLOCK - 1) {
+        memSize = (size_t)(FSBA_NO_BLOCK - 1) * blockSize;
+    }
+#endif
+    
     /* if the total number of allocatable blocks was requested, give it */
     if (pBlockCount != NULL) *pBlockCount = memSize / blockSize;
     
+#ifndef FSBA_ATOMIC
     pAllocator->pFreeMemBegin = pBlockMemBegin;
     pAllocator->pFreeMemEnd = pBlockMemBegin + memSize;
     pAllocator->blockSize = blockSize;
     pAllocator->pFreeBlock = NULL;
+#ifdef FSBA_REMOTE_FREE
+    pAllocator->pRemoteFreeBlock = NULL;
+#endif
+    pAllocator->pRegion = &pAllocator->firstRegion;
+    pAllocator->firstRegion.pNext = NULL;
+    pAllocator->firstRegion.pBlockMemBegin = pBlockMemBegin;
+    pAllocator->firstRegion.pBlockMemEnd = pBlockMemBegin + memSize;
+    pAllocator->firstRegion.firstIndex = 0;
+    pAllocator->blockAlign = blockAlign;
+    pAllocator->mark.pRegion = &pAllocator->firstRegion;
+    pAllocator->mark.offset = 0;
+#else
+    pAllocator->blockMemOffset = (size_t)(pBlockMemBegin - (char*)pAllocator);
+    pAllocator->freeMemBegin = 0;
+    pAllocator->freeMemEnd = memSize;
+    pAllocator->blockSize = blockSize;
+    pAllocator->freeBlock = fsba_makeHead(FSBA_NO_BLOCK, 0);
+    pAllocator->markOffset = 0;
+    pAllocator->sortCount = 0;
+    pAllocator->sortsDone = 0;
+#endif
     
     return pAllocator;
     
@@ -232,28 +964,1178 @@ out_of_memory:
     return NULL;
 }
 
-void* fsbaAllocate(FsbaAllocator* pAllocator)
+#ifndef FSBA_ATOMIC
+
+size_t fsbaAddMemory(FsbaAllocator* pAllocator, void* pMem, size_t memSize)
 {
-    void* out = pAllocator->pFreeBlock;
+    struct fsba_Region* pRegion;
+    struct fsba_Region* pLast;
+    char* pBlockMemBegin;
+    size_t memUsed;
+    
+    if (pMem == NULL) return 0;
+    
+    /* the region header goes first, like the allocator itself does */
+    pRegion = fsba_alignUp(pMem, fsba_alignof(struct fsba_Region));
+    pBlockMemBegin = fsba_alignUp(pRegion + 1, pAllocator->blockAlign);
+    
+    memUsed = (size_t)(pBlockMemBegin - (char*)pMem);
+    if (memUsed > memSize) return 0;
+    memSize = fsba_roundDown(memSize - memUsed, pAllocator->blockSize);
+    if (memSize == 0) return 0;
+    
+    pRegion->pNext = NULL;
+    pRegion->pBlockMemBegin = pBlockMemBegin;
+    pRegion->pBlockMemEnd = pBlockMemBegin + memSize;
+    
+    /* regions are used, and their blocks numbered, in the order they were added */
+    pLast = &pAllocator->firstRegion;
+    while (pLast->pNext != NULL) pLast = pLast->pNext;
+    pRegion->firstIndex = pLast->firstIndex + (size_t)(
+        pLast->pBlockMemEnd - pLast->pBlockMemBegin) / pAllocator->blockSize;
+    pLast->pNext = pRegion;
+    
+    return memSize / pAllocator->blockSize;
+}
+
+/* moves the bump pointer on to the next region, which must exist */
+static void fsba_enterNextRegion(FsbaAllocator* pAllocator)
+{
+    struct fsba_Region* pRegion = pAllocator->pRegion->pNext;
+    pAllocator->pFreeMemBegin = pRegion->pBlockMemBegin;
+    pAllocator->pFreeMemEnd = pRegion->pBlockMemEnd;
+    pAllocator->pRegion = pRegion;
+}
+
+void* fsbaAllocate(FsbaAllocator* pAllocator)
+{
+    void* out = pAllocator->pFreeBlock;
     if (out != NULL) {
         pAllocator->pFreeBlock = *pAllocator->pFreeBlock;
+        FSBA_ON_ALLOCATE(pAllocator, out, pAllocator->blockSize);
         return out;
     }
+#ifdef FSBA_REMOTE_FREE
+    /* take over all blocks freed by other threads before touching fresh ones */
+    if (__atomic_load_n(&pAllocator->pRemoteFreeBlock, __ATOMIC_RELAXED) != NULL) {
+        out = __atomic_exchange_n(
+            &pAllocator->pRemoteFreeBlock, NULL, __ATOMIC_ACQUIRE);
+        pAllocator->pFreeBlock = *(void**)out;
+        FSBA_ON_ALLOCATE(pAllocator, out, pAllocator->blockSize);
+        return out;
+    }
+#endif
     if (pAllocator->pFreeMemBegin >= pAllocator->pFreeMemEnd) {
-        return NULL;
+        if (pAllocator->pRegion->pNext == NULL) {
+            return NULL;
+        }
+        fsba_enterNextRegion(pAllocator);
     }
     out = pAllocator->pFreeMemBegin;
     pAllocator->pFreeMemBegin += pAllocator->blockSize;
+    FSBA_ON_ALLOCATE(pAllocator, out, pAllocator->blockSize);
     return out;
 }
 
 void fsbaFree(FsbaAllocator* pAllocator, void* pBlock)
 {
     if (pBlock == NULL) return;
+    FSBA_ON_FREE(pAllocator, pBlock);
     *(void**)pBlock = pAllocator->pFreeBlock;
     pAllocator->pFreeBlock = pBlock;
 }
 
+size_t fsbaAllocateN(FsbaAllocator* pAllocator, void** ppBlocks, size_t count)
+{
+    size_t i = 0, run;
+    char* pBlock;
+    
+    /* blocks on the free list first, as `fsbaAllocate` would */
+    for (;;) {
+        while (i < count && pAllocator->pFreeBlock != NULL) {
+            FSBA_ON_ALLOCATE(pAllocator, pAllocator->pFreeBlock, pAllocator->blockSize);
+            ppBlocks[i++] = pAllocator->pFreeBlock;
+            pAllocator->pFreeBlock = *pAllocator->pFreeBlock;
+        }
+#ifdef FSBA_REMOTE_FREE
+        if (i < count && __atomic_load_n(
+                &pAllocator->pRemoteFreeBlock, __ATOMIC_RELAXED) != NULL) {
+            pAllocator->pFreeBlock = __atomic_exchange_n(
+                &pAllocator->pRemoteFreeBlock, NULL, __ATOMIC_ACQUIRE);
+            continue;
+        }
+#endif
+        break;
+    }
+    
+    /* then runs of fresh blocks, one bounds check and one bump per region */
+    while (i < count) {
+        run = (size_t)(pAllocator->pFreeMemEnd - pAllocator->pFreeMemBegin)
+            / pAllocator->blockSize;
+        if (run == 0) {
+            if (pAllocator->pRegion->pNext == NULL) break;
+            fsba_enterNextRegion(pAllocator);
+            continue;
+        }
+        if (run > count - i) run = count - i;
+        pBlock = pAllocator->pFreeMemBegin;
+        pAllocator->pFreeMemBegin += run * pAllocator->blockSize;
+        while (run-- > 0) {
+            FSBA_ON_ALLOCATE(pAllocator, pBlock, pAllocator->blockSize);
+            ppBlocks[i++] = pBlock;
+            pBlock += pAllocator->blockSize;
+        }
+    }
+    return i;
+}
+
+void fsbaFreeN(FsbaAllocator* pAllocator, void** ppBlocks, size_t count)
+{
+    void* head = pAllocator->pFreeBlock;
+    size_t i;
+    
+    /* link the blocks locally, so that the free list is stored to only once */
+    for (i = count; i-- > 0;) {
+        if (ppBlocks[i] == NULL) continue;
+        FSBA_ON_FREE(pAllocator, ppBlocks[i]);
+        *(void**)ppBlocks[i] = head;
+        head = ppBlocks[i];
+    }
+    pAllocator->pFreeBlock = head;
+}
+
+/*  Bottom-up merge sort of a list linked through its blocks: sorted runs of
+ *  `width` blocks are merged pairwise, with `width` doubling every pass until
+ *  a single run is left.
+ */
+static void* fsba_sortList(void* pList)
+{
+    void* pHead = pList;
+    void* pTail;
+    void* pNext;
+    void* p;
+    void* q;
+    size_t width, merges, pCount, qCount;
+    
+    for (width = 1;; width *= 2) {
+        p = pHead;
+        pHead = NULL;
+        pTail = NULL;
+        merges = 0;
+        while (p != NULL) {
+            merges += 1;
+            q = p;
+            for (pCount = 0; pCount < width && q != NULL; ++pCount) q = *(void**)q;
+            qCount = width;
+            while (pCount > 0 || (qCount > 0 && q != NULL)) {
+                if (pCount == 0 || (qCount > 0 && q != NULL && (size_t)q < (size_t)p)) {
+                    pNext = q;
+                    q = *(void**)q;
+                    qCount -= 1;
+                } else {
+                    pNext = p;
+                    p = *(void**)p;
+                    pCount -= 1;
+                }
+                if (pTail != NULL) *(void**)pTail = pNext;
+                else pHead = pNext;
+                pTail = pNext;
+            }
+            p = q;
+        }
+        if (pTail != NULL) *(void**)pTail = NULL;
+        if (merges <= 1) return pHead;
+    }
+}
+
+void fsbaSortFreeList(FsbaAllocator* pAllocator)
+{
+    void** pBlock;
+    void** pPrev = NULL;
+    void** pRun;
+    void** pBeforeRun = NULL;
+    char* pFloor = pAllocator->pRegion->pBlockMemBegin;
+    
+#ifdef FSBA_REMOTE_FREE
+    /* blocks freed by other threads get sorted in as well */
+    if (__atomic_load_n(&pAllocator->pRemoteFreeBlock, __ATOMIC_RELAXED) != NULL) {
+        pRun = __atomic_exchange_n(
+            &pAllocator->pRemoteFreeBlock, NULL, __ATOMIC_ACQUIRE);
+        for (pBlock = pRun; *pBlock != NULL; pBlock = *pBlock);
+        *pBlock = pAllocator->pFreeBlock;
+        pAllocator->pFreeBlock = pRun;
+    }
+#endif
+    pAllocator->pFreeBlock = fsba_sortList(pAllocator->pFreeBlock);
+    
+    /* find the last run of blocks without gaps between them */
+    pRun = pAllocator->pFreeBlock;
+    for (pBlock = pRun; pBlock != NULL; pBlock = *pBlock) {
+        if (pPrev != NULL && (char*)pBlock != (char*)pPrev + pAllocator->blockSize) {
+            pBeforeRun = pPrev;
+            pRun = pBlock;
+        }
+        pPrev = pBlock;
+    }
+    
+    /*  If it ends where the fresh memory begins, it is part of the current
+     *  region, as the headers of other regions keep them from touching it.
+     */
+    if (pPrev == NULL || (char*)pPrev + pAllocator->blockSize != pAllocator->pFreeMemBegin) {
+        return;
+    }
+    
+    /* blocks below the latest marker stay on the list, for `fsbaRelease` to skip */
+    if (pAllocator->mark.pRegion == pAllocator->pRegion) {
+        pFloor += pAllocator->mark.offset;
+    }
+    if ((char*)pRun < pFloor) {
+        pBeforeRun = (void**)(pFloor - pAllocator->blockSize);
+        pRun = (void**)pFloor;
+    }
+    if ((char*)pRun == pAllocator->pFreeMemBegin) return;
+    pAllocator->pFreeMemBegin = (char*)pRun;
+    if (pBeforeRun != NULL) *pBeforeRun = NULL;
+    else pAllocator->pFreeBlock = NULL;
+}
+
+/* the region holding `ptr`, or `NULL` */
+static const struct fsba_Region* fsba_regionOf(
+    const FsbaAllocator* pAllocator,
+    const void* ptr)
+{
+    const struct fsba_Region* pRegion = &pAllocator->firstRegion;
+    for (; pRegion != NULL; pRegion = pRegion->pNext) {
+        if ((const char*)ptr >= pRegion->pBlockMemBegin
+                && (const char*)ptr < pRegion->pBlockMemEnd) {
+            return pRegion;
+        }
+    }
+    return NULL;
+}
+
+int fsbaOwns(const FsbaAllocator* pAllocator, const void* ptr)
+{
+    return fsba_regionOf(pAllocator, ptr) != NULL;
+}
+
+size_t fsbaIndexOf(const FsbaAllocator* pAllocator, const void* pBlock)
+{
+    const struct fsba_Region* pRegion = fsba_regionOf(pAllocator, pBlock);
+    return pRegion->firstIndex + (size_t)(
+        (const char*)pBlock - pRegion->pBlockMemBegin) / pAllocator->blockSize;
+}
+
+void* fsbaAt(const FsbaAllocator* pAllocator, size_t index)
+{
+    const struct fsba_Region* pRegion = &pAllocator->firstRegion;
+    while (pRegion->pNext != NULL && index >= pRegion->pNext->firstIndex) {
+        pRegion = pRegion->pNext;
+    }
+    return pRegion->pBlockMemBegin
+         + (index - pRegion->firstIndex) * pAllocator->blockSize;
+}
+
+void fsbaReset(FsbaAllocator* pAllocator)
+{
+    FSBA_ON_RESET(pAllocator);
+    pAllocator->pRegion = &pAllocator->firstRegion;
+    pAllocator->pFreeMemBegin = pAllocator->firstRegion.pBlockMemBegin;
+    pAllocator->pFreeMemEnd = pAllocator->firstRegion.pBlockMemEnd;
+    pAllocator->pFreeBlock = NULL;
+#ifdef FSBA_REMOTE_FREE
+    pAllocator->pRemoteFreeBlock = NULL;
+#endif
+    pAllocator->mark.pRegion = &pAllocator->firstRegion;
+    pAllocator->mark.offset = 0;
+}
+
+FsbaMarker fsbaMark(FsbaAllocator* pAllocator)
+{
+    FsbaMarker marker;
+    marker.pRegion = pAllocator->pRegion;
+    marker.offset = (size_t)(
+        pAllocator->pFreeMemBegin - pAllocator->pRegion->pBlockMemBegin);
+    pAllocator->mark = marker;
+    return marker;
+}
+
+void fsbaRelease(FsbaAllocator* pAllocator, FsbaMarker marker)
+{
+    struct fsba_Region* pRegion = marker.pRegion;
+    char* pBegin = pRegion->pBlockMemBegin + marker.offset;
+    size_t floor = pRegion->firstIndex + marker.offset / pAllocator->blockSize;
+    void** pBlock;
+    void** pNext;
+    void** pTail = NULL;
+    
+#ifdef FSBA_REMOTE_FREE
+    /* blocks freed by other threads are filtered as well */
+    if (__atomic_load_n(&pAllocator->pRemoteFreeBlock, __ATOMIC_RELAXED) != NULL) {
+        pNext = __atomic_exchange_n(
+            &pAllocator->pRemoteFreeBlock, NULL, __ATOMIC_ACQUIRE);
+        for (pBlock = pNext; *pBlock != NULL; pBlock = *pBlock);
+        *pBlock = pAllocator->pFreeBlock;
+        pAllocator->pFreeBlock = pNext;
+    }
+#endif
+    
+    /* free blocks below the marker stay on the list, in their order */
+    pBlock = pAllocator->pFreeBlock;
+    pAllocator->pFreeBlock = NULL;
+    for (; pBlock != NULL; pBlock = pNext) {
+        pNext = *pBlock;
+        if (fsbaIndexOf(pAllocator, pBlock) >= floor) continue;
+        if (pTail != NULL) *pTail = pBlock;
+        else pAllocator->pFreeBlock = pBlock;
+        pTail = pBlock;
+    }
+    if (pTail != NULL) *pTail = NULL;
+    
+    /* the fresh blocks handed out since the marker, a range per region */
+    for (; pRegion != pAllocator->pRegion; pRegion = pRegion->pNext) {
+        FSBA_ON_RELEASE(pAllocator, pBegin, pRegion->pBlockMemEnd);
+        pBegin = pRegion->pNext->pBlockMemBegin;
+    }
+    FSBA_ON_RELEASE(pAllocator, pBegin, pAllocator->pFreeMemBegin);
+    
+    pRegion = marker.pRegion;
+    pAllocator->pRegion = pRegion;
+    pAllocator->pFreeMemBegin = pRegion->pBlockMemBegin + marker.offset;
+    pAllocator->pFreeMemEnd = pRegion->pBlockMemEnd;
+    pAllocator->mark = marker;
+}
+
+#ifdef FSBA_REMOTE_FREE
+
+void fsbaFreeRemote(FsbaAllocator* pAllocator, void* pBlock)
+{
+    void* head;
+    
+    if (pBlock == NULL) return;
+    FSBA_ON_FREE(pAllocator, pBlock);
+    head = __atomic_load_n(&pAllocator->pRemoteFreeBlock, __ATOMIC_RELAXED);
+    do {
+        *(void**)pBlock = head;
+    } while (!__atomic_compare_exchange_n(
+                &pAllocator->pRemoteFreeBlock,
+                &head,
+                pBlock,
+                1,
+                __ATOMIC_RELEASE,
+                __ATOMIC_RELAXED));
+}
+
+#endif /* FSBA_REMOTE_FREE */
+
+#else /* FSBA_ATOMIC */
+
+/*  While `fsbaSortFreeList` holds the blocks it took off the free list, the
+ *  list can look empty. An allocation that also finds no fresh memory calls
+ *  this with the count of finished sorts it read before it looked at the
+ *  list. It returns nonzero, so that the allocation tries again, once a sort
+ *  has finished since then, and 0 if none has and none is running.
+ */
+static int fsba_waitForSort(FsbaAllocator* pAllocator, unsigned sortsDone)
+{
+    unsigned spins = 1, i;
+    
+    while (__atomic_load_n(&pAllocator->sortsDone, __ATOMIC_ACQUIRE) == sortsDone) {
+        /* a sort counts itself done before it stops counting as running */
+        if (__atomic_load_n(&pAllocator->sortCount, __ATOMIC_ACQUIRE) == 0) {
+            return __atomic_load_n(&pAllocator->sortsDone, __ATOMIC_ACQUIRE) != sortsDone;
+        }
+        
+        /* spin twice as long every round, then leave the processor to the sorter */
+        if (spins < FSBA_MAX_SPINS) {
+            for (i = 0; i < spins; ++i) fsba_pause();
+            spins *= 2;
+        }
+        else fsba_yield();
+    }
+    return 1;
+}
+
+void* fsbaAllocate(FsbaAllocator* pAllocator)
+{
+    fsba_Head head;
+    unsigned sortsDone;
+    size_t offset;
+    
+    for (;;) {
+        sortsDone = __atomic_load_n(&pAllocator->sortsDone, __ATOMIC_ACQUIRE);
+        head = __atomic_load_n(&pAllocator->freeBlock, __ATOMIC_ACQUIRE);
+        while (fsba_headIndex(head) != FSBA_NO_BLOCK) {
+            char* pBlock = fsba_blockMem(pAllocator)
+                         + (size_t)fsba_headIndex(head) * pAllocator->blockSize;
+            
+            /*  Another thread may pop this block and write into it before our
+             *  compare-exchange, in which case we read garbage here. The tag
+             *  makes the compare-exchange fail in that case, and the garbage
+             *  is dropped.
+             */
+            fsba_Index next = __atomic_load_n((fsba_Index*)pBlock, __ATOMIC_RELAXED);
+            
+            if (__atomic_compare_exchange_n(
+                    &pAllocator->freeBlock,
+                    &head,
+                    fsba_makeHead(next, fsba_headTag(head) + 1),
+                    1,
+                    __ATOMIC_ACQUIRE,
+                    __ATOMIC_ACQUIRE)) {
+                FSBA_ON_ALLOCATE(pAllocator, pBlock, pAllocator->blockSize);
+                return pBlock;
+            }
+        }
+        
+        /* check before claiming so that failed claims cannot wrap the offset */
+        if (__atomic_load_n(&pAllocator->freeMemBegin, __ATOMIC_RELAXED)
+                < pAllocator->freeMemEnd) {
+            offset = __atomic_fetch_add(
+                &pAllocator->freeMemBegin, pAllocator->blockSize, __ATOMIC_RELAXED);
+            if (offset < pAllocator->freeMemEnd) {
+                FSBA_ON_ALLOCATE(
+                    pAllocator, fsba_blockMem(pAllocator) + offset, pAllocator->blockSize);
+                return fsba_blockMem(pAllocator) + offset;
+            }
+        }
+        
+        if (!fsba_waitForSort(pAllocator, sortsDone)) return NULL;
+    }
+}
+
+void fsbaFree(FsbaAllocator* pAllocator, void* pBlock)
+{
+    fsba_Index index;
+    fsba_Head head;
+    
+    if (pBlock == NULL) return;
+    FSBA_ON_FREE(pAllocator, pBlock);
+    index = (fsba_Index)(
+        ((char*)pBlock - fsba_blockMem(pAllocator)) / pAllocator->blockSize);
+    head = __atomic_load_n(&pAllocator->freeBlock, __ATOMIC_RELAXED);
+    do {
+        __atomic_store_n((fsba_Index*)pBlock, fsba_headIndex(head), __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(
+                &pAllocator->freeBlock,
+                &head,
+                fsba_makeHead(index, fsba_headTag(head) + 1),
+                1,
+                __ATOMIC_RELEASE,
+                __ATOMIC_RELAXED));
+}
+
+FsbaAllocator* fsbaAttachAllocator(void* pMem)
+{
+    if (pMem == NULL) return NULL;
+    return fsba_alignUp(pMem, fsba_alignof(FsbaAllocator));
+}
+
+int fsbaOwns(const FsbaAllocator* pAllocator, const void* ptr)
+{
+    return (const char*)ptr >= fsba_blockMem(pAllocator)
+        && (const char*)ptr < fsba_blockMem(pAllocator) + pAllocator->freeMemEnd;
+}
+
+size_t fsbaIndexOf(const FsbaAllocator* pAllocator, const void* pBlock)
+{
+    return (size_t)((const char*)pBlock - fsba_blockMem(pAllocator))
+         / pAllocator->blockSize;
+}
+
+void* fsbaAt(const FsbaAllocator* pAllocator, size_t index)
+{
+    return fsba_blockMem(pAllocator) + index * pAllocator->blockSize;
+}
+
+static char* fsba_blockAt(FsbaAllocator* pAllocator, fsba_Index index)
+{
+    return fsba_blockMem(pAllocator) + (size_t)index * pAllocator->blockSize;
+}
+
+static fsba_Index* fsba_link(FsbaAllocator* pAllocator, fsba_Index index)
+{
+    return (fsba_Index*)fsba_blockAt(pAllocator, index);
+}
+
+/*  The tag is still advanced, so that a thread that read the head before the
+ *  reset, in violation of the contract, fails its compare-exchange rather
+ *  than corrupting the free list.
+ */
+static void fsba_clearFreeList(FsbaAllocator* pAllocator)
+{
+    fsba_Head head = __atomic_load_n(&pAllocator->freeBlock, __ATOMIC_RELAXED);
+    __atomic_store_n(
+        &pAllocator->freeBlock,
+        fsba_makeHead(FSBA_NO_BLOCK, fsba_headTag(head) + 1),
+        __ATOMIC_RELEASE);
+}
+
+void fsbaReset(FsbaAllocator* pAllocator)
+{
+    FSBA_ON_RESET(pAllocator);
+    __atomic_store_n(&pAllocator->freeMemBegin, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&pAllocator->markOffset, 0, __ATOMIC_RELAXED);
+    fsba_clearFreeList(pAllocator);
+}
+
+FsbaMarker fsbaMark(FsbaAllocator* pAllocator)
+{
+    FsbaMarker marker;
+    marker.pRegion = NULL;
+    marker.offset = __atomic_load_n(&pAllocator->freeMemBegin, __ATOMIC_RELAXED);
+    if (marker.offset > pAllocator->freeMemEnd) {
+        marker.offset = pAllocator->freeMemEnd;
+    }
+    __atomic_store_n(&pAllocator->markOffset, marker.offset, __ATOMIC_RELAXED);
+    return marker;
+}
+
+void fsbaRelease(FsbaAllocator* pAllocator, FsbaMarker marker)
+{
+    size_t freeMemBegin = __atomic_load_n(&pAllocator->freeMemBegin, __ATOMIC_RELAXED);
+    fsba_Head head = __atomic_load_n(&pAllocator->freeBlock, __ATOMIC_RELAXED);
+    fsba_Index floor = (fsba_Index)(marker.offset / pAllocator->blockSize);
+    fsba_Index index, next, first = FSBA_NO_BLOCK, last = FSBA_NO_BLOCK;
+    
+    /* failed claims may have bumped the offset past the end */
+    if (freeMemBegin > pAllocator->freeMemEnd) freeMemBegin = pAllocator->freeMemEnd;
+    FSBA_ON_RELEASE(
+        pAllocator,
+        fsba_blockMem(pAllocator) + marker.offset,
+        fsba_blockMem(pAllocator) + freeMemBegin);
+    __atomic_store_n(&pAllocator->freeMemBegin, marker.offset, __ATOMIC_RELAXED);
+    __atomic_store_n(&pAllocator->markOffset, marker.offset, __ATOMIC_RELAXED);
+    
+    /* free blocks below the marker stay on the list, in their order */
+    for (index = fsba_headIndex(head); index != FSBA_NO_BLOCK; index = next) {
+        next = __atomic_load_n(fsba_link(pAllocator, index), __ATOMIC_RELAXED);
+        if (index >= floor) continue;
+        if (last != FSBA_NO_BLOCK) {
+            __atomic_store_n(fsba_link(pAllocator, last), index, __ATOMIC_RELAXED);
+        } else {
+            first = index;
+        }
+        last = index;
+    }
+    if (last != FSBA_NO_BLOCK) {
+        __atomic_store_n(fsba_link(pAllocator, last), FSBA_NO_BLOCK, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(
+        &pAllocator->freeBlock,
+        fsba_makeHead(first, fsba_headTag(head) + 1),
+        __ATOMIC_RELEASE);
+}
+
+#ifdef FSBA_REMOTE_FREE
+
+void fsbaFreeRemote(FsbaAllocator* pAllocator, void* pBlock)
+{
+    fsbaFree(pAllocator, pBlock);
+}
+
+#endif /* FSBA_REMOTE_FREE */
+
+/* pushes the chain of free blocks `first`..`last` with a single update */
+static void fsba_pushChain(
+    FsbaAllocator* pAllocator,
+    fsba_Index first,
+    fsba_Index last)
+{
+    fsba_Head head = __atomic_load_n(&pAllocator->freeBlock, __ATOMIC_RELAXED);
+    do {
+        __atomic_store_n(
+            fsba_link(pAllocator, last), fsba_headIndex(head), __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(
+                &pAllocator->freeBlock,
+                &head,
+                fsba_makeHead(first, fsba_headTag(head) + 1),
+                1,
+                __ATOMIC_RELEASE,
+                __ATOMIC_RELAXED));
+}
+
+/*  Pops up to `max` blocks off the free list with a single update, and returns
+ *  how many were popped. Like in `fsbaAllocate`, the links walked here may be
+ *  garbage written by other threads, but then the tag has changed and the
+ *  compare-exchange fails. Indices are range-checked before they are followed,
+ *  so that garbage is never dereferenced outside of the block memory.
+ */
+static size_t fsba_popChain(
+    FsbaAllocator* pAllocator,
+    size_t max,
+    fsba_Index* pFirst,
+    fsba_Index* pLast)
+{
+    fsba_Index blockCount =
+        (fsba_Index)(pAllocator->freeMemEnd / pAllocator->blockSize);
+    fsba_Head head = __atomic_load_n(&pAllocator->freeBlock, __ATOMIC_ACQUIRE);
+    
+    while (fsba_headIndex(head) != FSBA_NO_BLOCK) {
+        fsba_Index last = fsba_headIndex(head);
+        fsba_Index next;
+        size_t count = 1;
+        
+        for (;;) {
+            next = __atomic_load_n(fsba_link(pAllocator, last), __ATOMIC_RELAXED);
+            if (count == max || next == FSBA_NO_BLOCK) break;
+            if (next >= blockCount) break;
+            last = next;
+            count += 1;
+        }
+        if (next != FSBA_NO_BLOCK && next >= blockCount) {
+            head = __atomic_load_n(&pAllocator->freeBlock, __ATOMIC_ACQUIRE);
+            continue;
+        }
+        if (__atomic_compare_exchange_n(
+                &pAllocator->freeBlock,
+                &head,
+                fsba_makeHead(next, fsba_headTag(head) + 1),
+                1,
+                __ATOMIC_ACQUIRE,
+                __ATOMIC_ACQUIRE)) {
+            *pFirst = fsba_headIndex(head);
+            *pLast = last;
+            return count;
+        }
+    }
+    return 0;
+}
+
+/*  Claims up to `max` consecutive fresh blocks from the rest of the memory with
+ *  a single atomic add, and returns how many were claimed.
+ */
+static size_t fsba_claimRun(
+    FsbaAllocator* pAllocator,
+    size_t max,
+    fsba_Index* pFirst)
+{
+    size_t offset, count;
+    
+    if (__atomic_load_n(&pAllocator->freeMemBegin, __ATOMIC_RELAXED)
+            >= pAllocator->freeMemEnd) {
+        return 0;
+    }
+    offset = __atomic_fetch_add(
+        &pAllocator->freeMemBegin,
+        max * pAllocator->blockSize,
+        __ATOMIC_RELAXED);
+    if (offset >= pAllocator->freeMemEnd) {
+        return 0;
+    }
+    count = (pAllocator->freeMemEnd - offset) / pAllocator->blockSize;
+    if (count > max) count = max;
+    *pFirst = (fsba_Index)(offset / pAllocator->blockSize);
+    return count;
+}
+
+/* like `fsba_claimRun`, but links the claimed blocks into a chain */
+static size_t fsba_claimChain(
+    FsbaAllocator* pAllocator,
+    size_t max,
+    fsba_Index* pFirst,
+    fsba_Index* pLast)
+{
+    size_t count = fsba_claimRun(pAllocator, max, pFirst);
+    size_t i;
+    
+    for (i = 1; i < count; ++i) {
+        __atomic_store_n(
+            fsba_link(pAllocator, *pFirst + (fsba_Index)i - 1),
+            *pFirst + (fsba_Index)i,
+            __ATOMIC_RELAXED);
+    }
+    *pLast = *pFirst + (fsba_Index)count - 1;
+    return count;
+}
+
+size_t fsbaAllocateN(FsbaAllocator* pAllocator, void** ppBlocks, size_t count)
+{
+    size_t i = 0, run;
+    fsba_Index first, last;
+    unsigned sortsDone;
+    
+    while (i < count) {
+        /* blocks on the free list first, as one chain */
+        sortsDone = __atomic_load_n(&pAllocator->sortsDone, __ATOMIC_ACQUIRE);
+        run = fsba_popChain(pAllocator, count - i, &first, &last);
+        while (run-- > 0) {
+            FSBA_ON_ALLOCATE(pAllocator, fsba_blockAt(pAllocator, first), pAllocator->blockSize);
+            ppBlocks[i++] = fsba_blockAt(pAllocator, first);
+            first = *fsba_link(pAllocator, first);
+        }
+        
+        /* then fresh blocks, with a single atomic add */
+        if (i < count) {
+            run = fsba_claimRun(pAllocator, count - i, &first);
+            while (run-- > 0) {
+                FSBA_ON_ALLOCATE(
+                    pAllocator, fsba_blockAt(pAllocator, first), pAllocator->blockSize);
+                ppBlocks[i++] = fsba_blockAt(pAllocator, first++);
+            }
+        }
+        if (i < count && !fsba_waitForSort(pAllocator, sortsDone)) break;
+    }
+    return i;
+}
+
+void fsbaFreeN(FsbaAllocator* pAllocator, void** ppBlocks, size_t count)
+{
+    fsba_Index first = FSBA_NO_BLOCK, last = FSBA_NO_BLOCK;
+    size_t i;
+    
+    /* link the blocks locally, then push them with a single update */
+    for (i = count; i-- > 0;) {
+        fsba_Index index;
+        if (ppBlocks[i] == NULL) continue;
+        FSBA_ON_FREE(pAllocator, ppBlocks[i]);
+        index = (fsba_Index)(
+            ((char*)ppBlocks[i] - fsba_blockMem(pAllocator)) / pAllocator->blockSize);
+        __atomic_store_n((fsba_Index*)ppBlocks[i], first, __ATOMIC_RELAXED);
+        if (last == FSBA_NO_BLOCK) last = index;
+        first = index;
+    }
+    if (first != FSBA_NO_BLOCK) fsba_pushChain(pAllocator, first, last);
+}
+
+/*  The merge sort of `fsba_sortList`, for a chain of block indices. The chain
+ *  must have been taken off the free list; links are still stored atomically,
+ *  as other threads may be reading them speculatively.
+ */
+static fsba_Index fsba_sortChain(FsbaAllocator* pAllocator, fsba_Index chain)
+{
+    fsba_Index head = chain, tail, next, p, q;
+    size_t width, merges, pCount, qCount;
+    
+    for (width = 1;; width *= 2) {
+        p = head;
+        head = FSBA_NO_BLOCK;
+        tail = FSBA_NO_BLOCK;
+        merges = 0;
+        while (p != FSBA_NO_BLOCK) {
+            merges += 1;
+            q = p;
+            for (pCount = 0; pCount < width && q != FSBA_NO_BLOCK; ++pCount) {
+                q = *fsba_link(pAllocator, q);
+            }
+            qCount = width;
+            while (pCount > 0 || (qCount > 0 && q != FSBA_NO_BLOCK)) {
+                if (pCount == 0 || (qCount > 0 && q != FSBA_NO_BLOCK && q < p)) {
+                    next = q;
+                    q = *fsba_link(pAllocator, q);
+                    qCount -= 1;
+                } else {
+                    next = p;
+                    p = *fsba_link(pAllocator, p);
+                    pCount -= 1;
+                }
+                if (tail != FSBA_NO_BLOCK) {
+                    __atomic_store_n(fsba_link(pAllocator, tail), next, __ATOMIC_RELAXED);
+                }
+                else head = next;
+                tail = next;
+            }
+            p = q;
+        }
+        if (tail != FSBA_NO_BLOCK) {
+            __atomic_store_n(fsba_link(pAllocator, tail), FSBA_NO_BLOCK, __ATOMIC_RELAXED);
+        }
+        if (merges <= 1) return head;
+    }
+}
+
+void fsbaSortFreeList(FsbaAllocator* pAllocator)
+{
+    fsba_Head head;
+    fsba_Index first, index, prev = FSBA_NO_BLOCK;
+    fsba_Index run, beforeRun = FSBA_NO_BLOCK, floor;
+    size_t freeMemBegin;
+    
+    /*  Take the whole list, so that no other thread pops from it while it is
+     *  sorted. The count is raised first, so that whoever sees the list
+     *  emptied here also sees that it is worth waiting for.
+     */
+    __atomic_fetch_add(&pAllocator->sortCount, 1, __ATOMIC_RELAXED);
+    head = __atomic_load_n(&pAllocator->freeBlock, __ATOMIC_RELAXED);
+    do {
+        if (fsba_headIndex(head) == FSBA_NO_BLOCK) {
+            __atomic_fetch_sub(&pAllocator->sortCount, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(
+                &pAllocator->freeBlock,
+                &head,
+                fsba_makeHead(FSBA_NO_BLOCK, fsba_headTag(head) + 1),
+                1,
+                __ATOMIC_ACQ_REL,
+                __ATOMIC_RELAXED));
+    
+    first = fsba_sortChain(pAllocator, fsba_headIndex(head));
+    
+    /* find the last run of consecutive blocks */
+    run = first;
+    for (index = first; index != FSBA_NO_BLOCK; index = *fsba_link(pAllocator, index)) {
+        if (prev != FSBA_NO_BLOCK && index != prev + 1) {
+            beforeRun = prev;
+            run = index;
+        }
+        prev = index;
+    }
+    
+    /* but not the blocks below the latest marker, for `fsbaRelease` to skip */
+    floor = (fsba_Index)(
+        __atomic_load_n(&pAllocator->markOffset, __ATOMIC_RELAXED) / pAllocator->blockSize);
+    if (run < floor) {
+        beforeRun = floor - 1;
+        run = floor;
+    }
+    
+    /* give it back to the fresh memory if it ends there and nobody claims from it meanwhile */
+    freeMemBegin = __atomic_load_n(&pAllocator->freeMemBegin, __ATOMIC_RELAXED);
+    if (run <= prev
+            && (size_t)prev + 1 == freeMemBegin / pAllocator->blockSize
+            && __atomic_compare_exchange_n(
+                &pAllocator->freeMemBegin,
+                &freeMemBegin,
+                (size_t)run * pAllocator->blockSize,
+                0,
+                __ATOMIC_RELAXED,
+                __ATOMIC_RELAXED)) {
+        prev = beforeRun;
+    }
+    if (prev != FSBA_NO_BLOCK) fsba_pushChain(pAllocator, first, prev);
+    
+    /* wake allocations waiting in `fsba_waitForSort` */
+    __atomic_fetch_add(&pAllocator->sortsDone, 1, __ATOMIC_RELEASE);
+    __atomic_fetch_sub(&pAllocator->sortCount, 1, __ATOMIC_RELEASE);
+}
+
+void fsbaInitCache(
+    FsbaCache* pCache,
+    FsbaAllocator* pAllocator,
+    size_t magazineSize)
+{
+    pCache->pAllocator = pAllocator;
+    pCache->magazineSize = magazineSize;
+    pCache->loaded.count = 0;
+    pCache->previous.count = 0;
+}
+
+void* fsbaCacheAllocate(FsbaCache* pCache)
+{
+    FsbaAllocator* pAllocator = pCache->pAllocator;
+    fsba_Index index;
+    unsigned sortsDone;
+    
+    if (pCache->loaded.count == 0) {
+        if (pCache->previous.count != 0) {
+            /* the previous magazine is full: swap it in */
+            pCache->loaded = pCache->previous;
+            pCache->previous.count = 0;
+        }
+        else {
+            /* an empty free list may only mean it is being sorted */
+            for (;;) {
+                sortsDone = __atomic_load_n(&pAllocator->sortsDone, __ATOMIC_ACQUIRE);
+                pCache->loaded.count = fsba_popChain(
+                    pAllocator,
+                    pCache->magazineSize,
+                    &pCache->loaded.first,
+                    &pCache->loaded.last);
+                if (pCache->loaded.count != 0) break;
+                pCache->loaded.count = fsba_claimChain(
+                    pAllocator,
+                    pCache->magazineSize,
+                    &pCache->loaded.first,
+                    &pCache->loaded.last);
+                if (pCache->loaded.count != 0) break;
+                if (!fsba_waitForSort(pAllocator, sortsDone)) return NULL;
+            }
+        }
+    }
+    index = pCache->loaded.first;
+    pCache->loaded.first = *fsba_link(pAllocator, index);
+    pCache->loaded.count -= 1;
+    FSBA_ON_ALLOCATE(pAllocator, fsba_blockAt(pAllocator, index), pAllocator->blockSize);
+    return fsba_blockAt(pAllocator, index);
+}
+
+void fsbaCacheFree(FsbaCache* pCache, void* pBlock)
+{
+    FsbaAllocator* pAllocator = pCache->pAllocator;
+    fsba_Index index;
+    
+    if (pBlock == NULL) return;
+    FSBA_ON_FREE(pAllocator, pBlock);
+    if (pCache->loaded.count == pCache->magazineSize) {
+        if (pCache->previous.count != 0) {
+            /* both magazines are full: hand the previous one back */
+            fsba_pushChain(
+                pAllocator, pCache->previous.first, pCache->previous.last);
+        }
+        pCache->previous = pCache->loaded;
+        pCache->loaded.count = 0;
+    }
+    index = (fsba_Index)(
+        ((char*)pBlock - fsba_blockMem(pAllocator)) / pAllocator->blockSize);
+    __atomic_store_n((fsba_Index*)pBlock, pCache->loaded.first, __ATOMIC_RELAXED);
+    if (pCache->loaded.count == 0) pCache->loaded.last = index;
+    pCache->loaded.first = index;
+    pCache->loaded.count += 1;
+}
+
+void fsbaFlushCache(FsbaCache* pCache)
+{
+    if (pCache->loaded.count != 0) {
+        fsba_pushChain(
+            pCache->pAllocator, pCache->loaded.first, pCache->loaded.last);
+        pCache->loaded.count = 0;
+    }
+    if (pCache->previous.count != 0) {
+        fsba_pushChain(
+            pCache->pAllocator, pCache->previous.first, pCache->previous.last);
+        pCache->previous.count = 0;
+    }
+}
+
+#endif /* FSBA_ATOMIC */
+
+/*  Bitmap allocators keep a set bit for every free block. Bits past the last
+ *  block are kept clear, so that they look allocated to allocation and are
+ *  masked off by iteration.
+ */
+struct FsbaBitmapAllocator {
+    size_t* pWords;
+    char* pBlockMem;
+    size_t blockSize;
+    size_t blockCount;
+    size_t wordCount;
+    size_t firstFreeWord; /* no word before this one has a set bit */
+    size_t pageSize;
+    void (*pfnRelease)(void* pPages, size_t size);
+    size_t dirtyBegin;    /* words freed into since the last release, */
+    size_t dirtyEnd;      /* or all of them before the first one */
+};
+
+#define FSBA_WORD_BITS (sizeof(size_t) * CHAR_BIT)
+
+/* index of the lowest set bit of a nonzero word */
+static unsigned fsba_ctz(size_t word)
+{
+#if defined(__GNUC__)
+    return (unsigned)__builtin_ctzll(word);
+#elif defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return (unsigned)index;
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, word);
+    return (unsigned)index;
+#else
+    unsigned index = 0;
+    while ((word & 1) == 0) {
+        word >>= 1;
+        index += 1;
+    }
+    return index;
+#endif
+}
+
+FsbaBitmapAllocator* fsbaEmplaceBitmapAllocator(
+    void* pMem,
+    size_t memSize,
+    size_t blockSize,
+    size_t blockAlign,
+    size_t* pBlockCount)
+{
+    FsbaBitmapAllocator* pAllocator;
+    size_t* pWords;
+    char* pMemEnd;
+    char* pBlockMemBegin;
+    size_t blockCount, wordCount, i;
+    
+    if (pMem == NULL) goto out_of_memory;
+    
+    pAllocator = fsba_alignUp(pMem, fsba_alignof(FsbaBitmapAllocator));
+    pWords = fsba_alignUp(pAllocator + 1, fsba_alignof(size_t));
+    pMemEnd = (char*)pMem + memSize;
+    if ((char*)pWords > pMemEnd) goto out_of_memory;
+    
+    if (blockSize == 0) blockSize = 1;
+    blockSize = fsba_roundUp(blockSize, blockAlign);
+#ifdef FSBA_CACHE_COLORING
+    blockSize = fsba_colorBlockSize(blockSize, blockAlign);
+#endif
+    
+    /*  Each block costs its size plus one bit. Start from that estimate and
+     *  give up blocks until the padding before the first block fits as well.
+     */
+    blockCount = (size_t)(pMemEnd - (char*)pWords) / blockSize;
+    blockCount -= blockCount / (blockSize * CHAR_BIT + 1);
+    for (;;) {
+        wordCount = (blockCount + FSBA_WORD_BITS - 1) / FSBA_WORD_BITS;
+        pBlockMemBegin = fsba_alignUp(pWords + wordCount, blockAlign);
+        if (pBlockMemBegin <= pMemEnd
+                && (size_t)(pMemEnd - pBlockMemBegin) / blockSize >= blockCount) {
+            break;
+        }
+        if (blockCount == 0) goto out_of_memory;
+        blockCount -= 1;
+    }
+    
+    if (pBlockCount != NULL) *pBlockCount = blockCount;
+    
+    for (i = 0; i < wordCount; ++i) pWords[i] = ~(size_t)0;
+    if (blockCount % FSBA_WORD_BITS != 0) {
+        pWords[wordCount - 1] = ((size_t)1 << (blockCount % FSBA_WORD_BITS)) - 1;
+    }
+    
+    pAllocator->pWords = pWords;
+    pAllocator->pBlockMem = pBlockMemBegin;
+    pAllocator->blockSize = blockSize;
+    pAllocator->blockCount = blockCount;
+    pAllocator->wordCount = wordCount;
+    pAllocator->firstFreeWord = 0;
+    pAllocator->pageSize = 0;
+    pAllocator->pfnRelease = NULL;
+    pAllocator->dirtyBegin = 0;
+    pAllocator->dirtyEnd = wordCount;
+    
+    return pAllocator;
+    
+out_of_memory:
+    
+    if (pBlockCount != NULL) *pBlockCount = 0;
+    return NULL;
+}
+
+void* fsbaBitmapAllocate(FsbaBitmapAllocator* pAllocator)
+{
+    size_t i = pAllocator->firstFreeWord;
+    size_t bit;
+    
+    while (i < pAllocator->wordCount && pAllocator->pWords[i] == 0) ++i;
+    pAllocator->firstFreeWord = i;
+    if (i == pAllocator->wordCount) return NULL;
+    
+    bit = fsba_ctz(pAllocator->pWords[i]);
+    pAllocator->pWords[i] &= pAllocator->pWords[i] - 1;
+    return pAllocator->pBlockMem
+         + (i * FSBA_WORD_BITS + bit) * pAllocator->blockSize;
+}
+
+/* whether the blocks `first` through `last` are all free */
+static int fsba_bitsSet(const FsbaBitmapAllocator* pAllocator, size_t first, size_t last)
+{
+    size_t i = first / FSBA_WORD_BITS;
+    size_t mask = ~(size_t)0 << (first % FSBA_WORD_BITS);
+    
+    for (; i < last / FSBA_WORD_BITS; ++i) {
+        if ((pAllocator->pWords[i] & mask) != mask) return 0;
+        mask = ~(size_t)0;
+    }
+    mask &= ~(size_t)0 >> (FSBA_WORD_BITS - 1 - last % FSBA_WORD_BITS);
+    return (pAllocator->pWords[i] & mask) == mask;
+}
+
+/* whether every block overlapping the page is free; pages outside the blocks never are */
+static int fsba_pageFree(const FsbaBitmapAllocator* pAllocator, size_t page)
+{
+    size_t blockMemBegin = (size_t)pAllocator->pBlockMem;
+    size_t blockMemEnd = blockMemBegin + pAllocator->blockCount * pAllocator->blockSize;
+    
+    if (page < blockMemBegin || page + pAllocator->pageSize > blockMemEnd) return 0;
+    return fsba_bitsSet(pAllocator,
+        (page - blockMemBegin) / pAllocator->blockSize,
+        (page + pAllocator->pageSize - 1 - blockMemBegin) / pAllocator->blockSize);
+}
+
+void fsbaBitmapFree(FsbaBitmapAllocator* pAllocator, void* pBlock)
+{
+    size_t index;
+    
+    if (pBlock == NULL) return;
+    index = (size_t)((char*)pBlock - pAllocator->pBlockMem) / pAllocator->blockSize;
+    pAllocator->pWords[index / FSBA_WORD_BITS] |=
+        (size_t)1 << (index % FSBA_WORD_BITS);
+    if (index / FSBA_WORD_BITS < pAllocator->firstFreeWord) {
+        pAllocator->firstFreeWord = index / FSBA_WORD_BITS;
+    }
+    
+    /* only pages freed into can have become free for the next release */
+    if (index / FSBA_WORD_BITS < pAllocator->dirtyBegin) {
+        pAllocator->dirtyBegin = index / FSBA_WORD_BITS;
+    }
+    if (index / FSBA_WORD_BITS >= pAllocator->dirtyEnd) {
+        pAllocator->dirtyEnd = index / FSBA_WORD_BITS + 1;
+    }
+}
+
+void* fsbaBitmapNext(const FsbaBitmapAllocator* pAllocator, const void* pBlock)
+{
+    size_t index = 0, i, used;
+    
+    if (pBlock != NULL) {
+        index = (size_t)((const char*)pBlock - pAllocator->pBlockMem)
+              / pAllocator->blockSize + 1;
+    }
+    if (index >= pAllocator->blockCount) return NULL;
+    
+    /* allocated blocks are the clear bits, minus those past the last block */
+    i = index / FSBA_WORD_BITS;
+    used = ~pAllocator->pWords[i] & (~(size_t)0 << (index % FSBA_WORD_BITS));
+    for (;;) {
+        if (i == pAllocator->wordCount - 1
+                && pAllocator->blockCount % FSBA_WORD_BITS != 0) {
+            used &= ((size_t)1 << (pAllocator->blockCount % FSBA_WORD_BITS)) - 1;
+        }
+        if (used != 0) break;
+        if (++i == pAllocator->wordCount) return NULL;
+        used = ~pAllocator->pWords[i];
+    }
+    return pAllocator->pBlockMem
+         + (i * FSBA_WORD_BITS + fsba_ctz(used)) * pAllocator->blockSize;
+}
+
+void fsbaBitmapSetPageRelease(
+    FsbaBitmapAllocator* pAllocator,
+    size_t pageSize,
+    void (*pfnRelease)(void* pPages, size_t size))
+{
+    pAllocator->pageSize = pageSize;
+    pAllocator->pfnRelease = pfnRelease;
+}
+
+size_t fsbaBitmapReleaseFreePages(FsbaBitmapAllocator* pAllocator)
+{
+    size_t pageMask = pAllocator->pageSize - 1;
+    size_t first = pAllocator->dirtyBegin * FSBA_WORD_BITS;
+    size_t last = pAllocator->dirtyEnd * FSBA_WORD_BITS;
+    size_t page, end, runBegin, released = 0;
+    
+    if (pAllocator->pfnRelease == NULL || first >= last) return 0;
+    if (last > pAllocator->blockCount) last = pAllocator->blockCount;
+    
+    /* the pages under the dirty blocks; fsba_pageFree turns down those sticking out */
+    page = ((size_t)pAllocator->pBlockMem + first * pAllocator->blockSize) & ~pageMask;
+    end = ((size_t)pAllocator->pBlockMem + last * pAllocator->blockSize + pageMask) & ~pageMask;
+    
+    /* one call for each run of free pages */
+    for (runBegin = page; page < end; page += pAllocator->pageSize) {
+        if (fsba_pageFree(pAllocator, page)) continue;
+        if (page > runBegin) pAllocator->pfnRelease((void*)runBegin, page - runBegin);
+        released += page - runBegin;
+        runBegin = page + pAllocator->pageSize;
+    }
+    if (page > runBegin) pAllocator->pfnRelease((void*)runBegin, page - runBegin);
+    released += page - runBegin;
+    
+    pAllocator->dirtyBegin = pAllocator->wordCount;
+    pAllocator->dirtyEnd = 0;
+    return released;
+}
+
 size_t fsbaAllocatorSize(void)
 {
     return sizeof(FsbaAllocator);
@@ -264,6 +2146,26 @@ size_t fsbaAllocatorAlignment(void)
     return fsba_alignof(FsbaAllocator);
 }
 
+size_t fsbaMemorySize(size_t blockCount, size_t blockSize, size_t blockAlign)
+{
+    /* lay out the blocks as fsbaEmplaceAllocator does */
+    blockAlign = fsba_LCM(blockAlign, fsba_alignof(void*));
+    if (blockSize < sizeof(void*)) blockSize = sizeof(void*);
+    blockSize = fsba_roundUp(blockSize, blockAlign);
+#ifdef FSBA_CACHE_COLORING
+    blockSize = fsba_colorBlockSize(blockSize, blockAlign);
+#endif
+    
+    /* room for aligning both the allocator and the blocks after it */
+    return (fsba_alignof(FsbaAllocator) - 1) + sizeof(FsbaAllocator)
+        + (blockAlign - 1) + blockCount * blockSize;
+}
+
+size_t fsbaBlockSize(const FsbaAllocator* pAllocator)
+{
+    return pAllocator->blockSize;
+}
+
 #undef fsba_alignof
 
 #endif /* FSBA_IMPLEMENTATION */
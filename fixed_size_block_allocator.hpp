@@ -0,0 +1,359 @@
+/*
+fixed_size_block_allocator.hpp - public domain - github.com/cofinite
+
+The purpose of this library is to provide the allocator of
+fixed_size_block_allocator.h to C++, with its layout worked out at compile
+time. An `fsba::allocator<BlockSize, Align>` differs from a `FsbaAllocator` in
+a few ways:
+
++ the block size and alignment are template parameters: padding, rounding and
+  the stride between blocks are `constexpr`, and `allocate`/`deallocate`
+  inline down to a handful of instructions
++ alignments are powers of two, so aligning is masking rather than `%`
++ the allocator is an ordinary object, rather than being emplaced in the
+  memory it is given
++ `fsba::allocator` is header-only and does not need the implementation of
+  fixed_size_block_allocator.h
+
+Like `FsbaAllocator`, it takes memory from the user, and does not own it.
+
+Note that the allocator is neither copyable nor movable, as the blocks it has
+handed out belong to it.
+
+On top of a `FsbaAllocator`, `fsba::object_pool<T>` constructs and destroys
+objects of type `T` in its blocks. `make` forwards its arguments to a
+constructor of `T` and returns a `std::unique_ptr` whose deleter hands the
+object back to the pool; `create` and `destroy` do the same with plain
+pointers. `fsba::thread_local_pool<T, Capacity>()` gives every thread a pool of
+its own, so that objects are recycled without any locking, and without
+allocating once the pool of a thread is set up.
+
+This file also adapts a `FsbaAllocator` to the standard containers, so that
+node-based containers like `std::list`, `std::map`, `std::set` and
+`std::unordered_map` allocate their nodes from it (C++17):
+
++ `fsba::memory_resource` is a `std::pmr::memory_resource` that serves
+  requests that fit a block from a `FsbaAllocator`, and passes all others, and
+  those made while the allocator is out of blocks, on to an upstream resource
++ `fsba::node_allocator<T>` is an allocator, in the sense of `std::allocator`,
+  that allocates from a `std::pmr::memory_resource`, for containers that do not
+  take a polymorphic allocator
+
+The pools and adapters include fixed_size_block_allocator.h, whose implementation must be
+compiled, as C, in some source file.
+
+Example usage:
+
+    static char mem[1 << 16];
+    fsba::allocator<sizeof(Node), alignof(Node)> nodes(mem, sizeof mem);
+
+    Node* node = new (nodes.allocate()) Node();
+    // allocating a block and constructing an object in it
+
+    node->~Node();
+    nodes.deallocate(node);
+    // destroying the object and freeing its block
+
+    cout << nodes.capacity() << endl;
+    // prints the number of blocks that fit in `mem`
+
+    FsbaAllocator* blocks = fsbaEmplaceAllocator(mem, sizeof mem, 64, 16, NULL);
+    fsba::memory_resource resource(blocks, 16);
+    // serving requests that fit a block of `blocks`, with alignments of up to 16, from `blocks`
+
+    fsba::object_pool<Node> pool(mem, sizeof mem);
+    auto pooled = pool.make(1, 2);
+    // constructing a Node(1, 2) in a block of `pool`, freed when `pooled` goes out of scope
+
+    auto local = fsba::thread_local_pool<Node, 1024>().make(3, 4);
+    // the same from a pool of 1024 Nodes of the calling thread
+
+    std::pmr::map<int, int> pmrMap(&resource);
+    std::map<int, int, std::less<int>, fsba::node_allocator<std::pair<const int, int>>> map(&resource);
+    // both containers allocate their nodes from `blocks`
+
+
+LICENSE
+
+See end of file for license information.
+
+*/
+
+#ifndef FIXED_SIZE_BLOCK_ALLOCATOR_HPP_INCLUDED
+#define FIXED_SIZE_BLOCK_ALLOCATOR_HPP_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+
+namespace fsba {
+
+namespace detail {
+
+constexpr std::size_t max(std::size_t a, std::size_t b) { return a < b ? b : a; }
+
+constexpr std::size_t round_up(std::size_t num, std::size_t pow2) {
+    return (num + pow2 - 1) & ~(pow2 - 1);
+}
+
+constexpr bool is_pow2(std::size_t num) { return num != 0 && (num & (num - 1)) == 0; }
+
+inline char* align_up(void* ptr, std::size_t pow2) {
+    return reinterpret_cast<char*>(round_up(reinterpret_cast<std::uintptr_t>(ptr), pow2));
+}
+
+} // namespace detail
+
+template <
+    std::size_t BlockSize,
+    std::size_t Align = alignof(std::max_align_t)
+> class allocator {
+    static_assert(detail::is_pow2(Align), "Align must be a power of two");
+
+public:
+    typedef std::size_t size_type;
+
+    // blocks hold a pointer while free, so they are at least as large and as aligned
+    static constexpr size_type block_align = detail::max(Align, alignof(void*));
+    static constexpr size_type block_size  = detail::round_up(detail::max(BlockSize, sizeof(void*)), block_align);
+
+    allocator(void* mem, size_type size) noexcept {
+        char* begin = detail::align_up(mem, block_align);
+        char* end   = static_cast<char*>(mem) + size;
+        size_type count = begin < end ? static_cast<size_type>(end - begin) / block_size : 0;
+        mem_begin  = begin;
+        free_begin = begin;
+        free_end   = begin + count * block_size;
+    }
+
+    allocator(const allocator&) = delete;
+    allocator& operator=(const allocator&) = delete;
+
+    void* allocate() noexcept {
+        if (void** block = free_block) {
+            free_block = static_cast<void**>(*block);
+            return block;
+        }
+        if (free_begin == free_end) {
+            return nullptr;
+        }
+        char* block = free_begin;
+        free_begin += block_size;
+        return block;
+    }
+
+    void deallocate(void* block) noexcept {
+        if (block == nullptr) return;
+        *static_cast<void**>(block) = free_block;
+        free_block = static_cast<void**>(block);
+    }
+
+    size_type capacity() const noexcept { return static_cast<size_type>(free_end - mem_begin) / block_size; }
+
+    bool owns(const void* ptr) const noexcept {
+        return static_cast<const char*>(ptr) >= mem_begin && static_cast<const char*>(ptr) < free_end;
+    }
+
+    size_type index_of(const void* block) const noexcept {
+        return static_cast<size_type>(static_cast<const char*>(block) - mem_begin) / block_size;
+    }
+
+    void* at(size_type index) const noexcept { return mem_begin + index * block_size; }
+
+private:
+    void** free_block = nullptr;
+    char*  free_begin;
+    char*  free_end;
+    char*  mem_begin;
+};
+
+template <std::size_t BlockSize, std::size_t Align>
+constexpr typename allocator<BlockSize, Align>::size_type allocator<BlockSize, Align>::block_align;
+
+template <std::size_t BlockSize, std::size_t Align>
+constexpr typename allocator<BlockSize, Align>::size_type allocator<BlockSize, Align>::block_size;
+
+} // namespace fsba
+
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "fixed_size_block_allocator.h"
+
+namespace fsba {
+
+template <class T> class object_pool {
+public:
+    typedef T value_type;
+
+    struct deleter {
+        object_pool* pool;
+        void operator()(T* object) const noexcept { pool->destroy(object); }
+    };
+
+    typedef std::unique_ptr<T, deleter> pointer;
+
+    // emplaces a FsbaAllocator in `mem`, with blocks that fit a T
+    object_pool(void* mem, std::size_t size) noexcept
+        : blocks(fsbaEmplaceAllocator(mem, size, sizeof(T), alignof(T), nullptr)) {}
+
+    // takes blocks from an existing FsbaAllocator, which must fit a T
+    explicit object_pool(FsbaAllocator* blocks) noexcept : blocks(blocks) {}
+
+    object_pool(const object_pool&) = delete;
+    object_pool& operator=(const object_pool&) = delete;
+
+    // returns nullptr if the pool is out of blocks; if the constructor throws, the block is freed again
+    template <class... Args> T* create(Args&&... args) {
+        void* block = blocks != nullptr ? fsbaAllocate(blocks) : nullptr;
+        if (block == nullptr) return nullptr;
+        block_guard guard = {blocks, block};
+        T* object = ::new (block) T(std::forward<Args>(args)...);
+        guard.block = nullptr;
+        return object;
+    }
+
+    void destroy(T* object) noexcept {
+        if (object == nullptr) return;
+        object->~T();
+        fsbaFree(blocks, object);
+    }
+
+    // returns an empty pointer if the pool is out of blocks
+    template <class... Args> pointer make(Args&&... args) {
+        return pointer(create(std::forward<Args>(args)...), deleter{this});
+    }
+
+    FsbaAllocator* block_allocator() const noexcept { return blocks; }
+
+private:
+    struct block_guard {
+        FsbaAllocator* blocks;
+        void* block;
+        ~block_guard() { if (block != nullptr) fsbaFree(blocks, block); }
+    };
+
+    FsbaAllocator* blocks;
+};
+
+// A pool of at least Capacity objects for the calling thread, whose memory is allocated on first use and
+// freed when the thread exits. Objects must be destroyed on the thread that made them, before it exits.
+template <class T, std::size_t Capacity> object_pool<T>& thread_local_pool() {
+    struct local {
+        std::size_t size = fsbaMemorySize(Capacity, sizeof(T), alignof(T));
+        std::unique_ptr<char[]> mem{new char[size]};
+        object_pool<T> pool{mem.get(), size};
+    };
+    static thread_local local instance;
+    return instance.pool;
+}
+
+} // namespace fsba
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+
+#include <memory_resource>
+#include <new>
+#include <limits>
+
+#include "fixed_size_block_allocator.h"
+
+namespace fsba {
+
+class memory_resource : public std::pmr::memory_resource {
+public:
+    // block_align must not exceed the alignment `blocks` was emplaced with; the block size is taken from `blocks`
+    memory_resource(
+        FsbaAllocator* blocks,
+        std::size_t block_align,
+        std::pmr::memory_resource* upstream = std::pmr::get_default_resource()
+    ) noexcept : blocks(blocks), block_size(fsbaBlockSize(blocks)), block_align(block_align), upstream(upstream) {}
+
+    memory_resource(const memory_resource&) = delete;
+    memory_resource& operator=(const memory_resource&) = delete;
+
+    FsbaAllocator* block_allocator() const noexcept { return blocks; }
+    std::pmr::memory_resource* upstream_resource() const noexcept { return upstream; }
+
+private:
+    FsbaAllocator* blocks;
+    std::size_t block_size;
+    std::size_t block_align;
+    std::pmr::memory_resource* upstream;
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        if (bytes <= block_size && alignment <= block_align) {
+            if (void* block = fsbaAllocate(blocks)) return block;
+        }
+        return upstream->allocate(bytes, alignment);
+    }
+
+    // blocks are told apart from upstream memory by address, since an exhausted allocator sends fitting requests upstream too
+    void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override {
+        if (fsbaOwns(blocks, ptr)) fsbaFree(blocks, ptr);
+        else upstream->deallocate(ptr, bytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
+
+template <class T> class node_allocator {
+public:
+    typedef T value_type;
+
+    node_allocator(std::pmr::memory_resource* resource) noexcept : resource(resource) {}
+
+    template <class U>
+    node_allocator(const node_allocator<U>& other) noexcept : resource(other.resource) {}
+
+    T* allocate(std::size_t n) {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        return static_cast<T*>(resource->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* ptr, std::size_t n) noexcept { resource->deallocate(ptr, n * sizeof(T), alignof(T)); }
+
+    template <class U> bool operator==(const node_allocator<U>& other) const noexcept { return *resource == *other.resource; }
+    template <class U> bool operator!=(const node_allocator<U>& other) const noexcept { return *resource != *other.resource; }
+
+    std::pmr::memory_resource* resource;
+};
+
+} // namespace fsba
+
+#endif /* __has_include(<memory_resource>) */
+#endif /* C++17 */
+
+#endif /* FIXED_SIZE_BLOCK_ALLOCATOR_HPP_INCLUDED */
+
+/*
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+
+*/
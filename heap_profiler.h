@@ -0,0 +1,524 @@
+/*
+heap_profiler.h - public domain - github.com/cofinite
+
+In exactly one source file, put:
+    #define HEAP_PROFILER_IMPLEMENTATION
+    #include "heap_profiler.h"
+
+Other source or header files should have just:
+    #include "heap_profiler.h"
+
+
+The purpose of this library is to find out which call sites keep pooled memory
+live, cheaply enough to leave it on in production. Rather than tracing every
+allocation, it samples about one allocation every so many bytes, records the
+stack of every sampled allocation until it is freed, and writes the samples out
+as a heap profile that pprof can read.
+
+The allocators of fixed_size_block_allocator.h and memory-pool.h call hooks
+that expand to nothing by default. Defined as below in the source file that
+compiles their implementations, the hooks report to this library:
+
+    #include "heap_profiler.h"
+
+    #define FSBA_ON_ALLOCATE(pAllocator, pBlock, size) HP_ALLOCATE(pAllocator, (size_t)(pBlock), size)
+    #define FSBA_ON_FREE(pAllocator, pBlock)           HP_FREE(pAllocator, (size_t)(pBlock))
+    #define FSBA_ON_RESET(pAllocator)                  hpForgetOwner(pAllocator)
+    #define FSBA_ON_RELEASE(pAllocator, pBegin, pEnd)  hpForgetRange(pAllocator, (size_t)(pBegin), (size_t)(pEnd))
+    #define FSBA_IMPLEMENTATION
+    #include "fixed_size_block_allocator.h"
+
+    #define MP_ON_ALLOC(pPool, handle, size)           HP_ALLOCATE(pPool, handle, size)
+    #define MP_ON_FREE(pPool, handle)                  HP_FREE(pPool, handle)
+    #define MP_ON_FREE_POOL(pPool)                     hpForgetOwner(pPool)
+    #define MEMORY_POOL_IMPLEMENTATION
+    #include "memory-pool.h"
+
+Other allocators can report the same way. An allocation is known by its owner,
+such as an allocator or a pool, and an id within the owner, such as the address
+of a block or a handle.
+
+Sampling is off until a rate is set, as the mean number of bytes between two
+samples. A profile can be written at any time:
+
+    hpSetSampleRate(512 * 1024);
+
+    ...
+
+    FILE* file = fopen("pool.heap", "w");
+    hpWriteProfile(file);
+    fclose(file);
+
+and then read with `pprof ./program pool.heap`. The profile is in the text
+format of gperftools' heap profiler, with the sampling rate in its header, so
+that pprof scales the samples back up to estimates of the actual numbers of
+objects and bytes. It lists both the allocations still live and all those
+sampled since the start, under the stacks that made them.
+
+Between samples, `HP_ALLOCATE` only subtracts the size from a thread-local
+counter. `HP_FREE` reads the number of live samples, and while there are any,
+one entry of a filter of the sampled allocations; only a sample, or a free the
+filter cannot rule out, takes a lock. With sampling off, every thread still
+checks in once every 64 KiB it allocates, to find out whether it was turned
+on again.
+
+At most `HP_MAX_SAMPLES` samples are live at once, and at most `HP_MAX_STACKS`
+distinct stacks are recorded, of up to `HP_MAX_FRAMES` frames each; samples
+beyond these are dropped. Each can be defined in the source file that compiles
+the implementation.
+
+This library needs the `__atomic` builtins and `__thread` of GCC or Clang,
+POSIX threads, and `backtrace` from glibc; link with `-pthread` and `-lm`.
+Allocations are sampled from the stack of the thread making them, so the stacks
+are only as good as the unwind information of the program.
+
+LICENSE
+
+See end of file for license information.
+
+*/
+
+#ifndef HP_INCLUDE_HEAP_PROFILER_H
+#define HP_INCLUDE_HEAP_PROFILER_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! @brief The number of entries in the filter of live samples. */
+#define HP_FILTER_SIZE 65536
+
+/*! @brief Reports an allocation.
+ *  
+ *  This macro counts the size of an allocation towards the next sample, and
+ *  samples the allocation once enough bytes have been allocated.
+ *  
+ *  @param[in] pOwner The allocator or pool that made the allocation.
+ *  
+ *  @param[in] id The allocation within its owner, as a `size_t`.
+ *  
+ *  @param[in] size The size of the allocation.
+ */
+#define HP_ALLOCATE(pOwner, id, size)                               \
+    ((hp_countdown -= (long)(size)) < 0                             \
+        ? hp_sample((pOwner), (size_t)(id), (size_t)(size))         \
+        : (void)0)
+
+/*! @brief Reports a free.
+ *  
+ *  This macro drops the sample of an allocation, if it was sampled. It must be
+ *  used before the memory can be allocated again.
+ *  
+ *  @param[in] pOwner The allocator or pool that made the allocation.
+ *  
+ *  @param[in] id The allocation within its owner, as a `size_t`.
+ */
+#define HP_FREE(pOwner, id)                                         \
+    (__atomic_load_n(&hp_liveCount, __ATOMIC_RELAXED) != 0          \
+        && __atomic_load_n(&hp_filter[hp_filterIndex((pOwner), (size_t)(id))], \
+            __ATOMIC_RELAXED) != 0                                  \
+        ? hp_forget((pOwner), (size_t)(id))                         \
+        : (void)0)
+
+/*! @brief Sets the sampling rate.
+ *  
+ *  @param[in] bytesPerSample The mean number of bytes allocated between two
+ *  samples, or `0` to turn sampling off. Samples already taken are kept.
+ */
+void hpSetSampleRate(size_t bytesPerSample);
+
+/*! @brief Returns the sampling rate.
+ *  
+ *  @return The mean number of bytes between two samples, or `0` if sampling
+ *  is off.
+ */
+size_t hpSampleRate(void);
+
+/*! @brief Drops the samples of an owner.
+ *  
+ *  This function drops all live samples of the given owner, as when a pool
+ *  frees all of its objects at once.
+ *  
+ *  @param[in] pOwner The allocator or pool.
+ */
+void hpForgetOwner(const void* pOwner);
+
+/*! @brief Drops the samples of an owner within a range of ids.
+ *  
+ *  This function drops the live samples of the given owner whose ids lie in
+ *  the given range, as when an arena frees everything allocated past a
+ *  marker but keeps what was allocated before it.
+ *  
+ *  @param[in] pOwner The allocator or pool.
+ *  
+ *  @param[in] lo The lowest id to drop.
+ *  
+ *  @param[in] hi The id past the highest one to drop.
+ */
+void hpForgetRange(const void* pOwner, size_t lo, size_t hi);
+
+/*! @brief Writes a heap profile.
+ *  
+ *  This function writes the samples taken so far, along with the memory
+ *  mappings of the process, as a heap profile that pprof can read.
+ *  
+ *  @param[in] pFile The file to write to.
+ *  
+ *  @return `1` on success, or `0` if writing failed.
+ */
+int hpWriteProfile(FILE* pFile);
+
+/* for internal use by the macros above */
+extern __thread long hp_countdown;
+extern size_t hp_liveCount;
+extern unsigned short hp_filter[HP_FILTER_SIZE];
+void hp_sample(const void* pOwner, size_t id, size_t size);
+void hp_forget(const void* pOwner, size_t id);
+
+#define hp_filterIndex(pOwner, id) \
+    (((((size_t)(pOwner) ^ (id)) * 2654435761u) >> 4) & (HP_FILTER_SIZE - 1))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HP_INCLUDE_HEAP_PROFILER_H */
+
+
+
+#if defined(HEAP_PROFILER_IMPLEMENTATION) && !defined(HEAP_PROFILER_IMPLEMENTATION_INCLUDED)
+#define HEAP_PROFILER_IMPLEMENTATION_INCLUDED
+
+#include <execinfo.h>
+#include <limits.h>
+#include <math.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef HP_MAX_SAMPLES
+#define HP_MAX_SAMPLES 4096
+#endif
+
+#ifndef HP_MAX_STACKS
+#define HP_MAX_STACKS 1024
+#endif
+
+#ifndef HP_MAX_FRAMES
+#define HP_MAX_FRAMES 32
+#endif
+
+/* samples are kept in an open-addressed table at most half full */
+#define HP_SAMPLE_SLOTS (2 * HP_MAX_SAMPLES)
+
+/* how often a thread checks whether sampling was turned on */
+#define HP_IDLE_BYTES 65536L
+
+struct hp_Stack {
+    void* frames[HP_MAX_FRAMES];
+    int depth;
+    size_t hash;
+    size_t liveCount;
+    size_t liveBytes;
+    size_t allocCount;
+    size_t allocBytes;
+};
+
+struct hp_Sample {
+    const void* pOwner; /* NULL if the slot is empty */
+    size_t id;
+    size_t size;
+    struct hp_Stack* pStack;
+};
+
+__thread long hp_countdown;
+size_t hp_liveCount;
+unsigned short hp_filter[HP_FILTER_SIZE];
+
+static __thread int hp_armed;
+static __thread unsigned long hp_random;
+
+static size_t hp_rate;
+static pthread_mutex_t hp_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct hp_Sample hp_samples[HP_SAMPLE_SLOTS];
+static struct hp_Stack hp_stacks[HP_MAX_STACKS];
+static size_t hp_stackCount;
+
+void hpSetSampleRate(size_t bytesPerSample)
+{
+    void* frame;
+    
+    /* the first backtrace loads the unwinder, which should not happen while sampling */
+    backtrace(&frame, 1);
+    __atomic_store_n(&hp_rate, bytesPerSample, __ATOMIC_RELAXED);
+}
+
+size_t hpSampleRate(void)
+{
+    return __atomic_load_n(&hp_rate, __ATOMIC_RELAXED);
+}
+
+/*  The distances between samples are drawn from an exponential distribution,
+ *  which makes every byte equally likely to be sampled, as pprof assumes when
+ *  it scales the samples back up.
+ */
+static long hp_nextInterval(size_t rate)
+{
+    double u, interval;
+    
+    if (hp_random == 0) {
+        hp_random = (((unsigned long)(size_t)&hp_random ^ (unsigned long)time(NULL))
+            & 0xFFFFFFFFUL) | 1;
+    }
+    /* xorshift32 */
+    hp_random ^= (hp_random << 13) & 0xFFFFFFFFUL;
+    hp_random ^= hp_random >> 17;
+    hp_random ^= (hp_random << 5) & 0xFFFFFFFFUL;
+    
+    u = ((double)(hp_random >> 8) + 1.0) / 16777216.0;
+    interval = -log(u) * (double)rate;
+    return interval < (double)LONG_MAX ? (long)interval + 1 : LONG_MAX;
+}
+
+static size_t hp_sampleHash(const void* pOwner, size_t id)
+{
+    return (((size_t)pOwner ^ id) * 2654435761u) >> 4;
+}
+
+/* empties a slot, moving later entries of its cluster back to fill the gap */
+static void hp_removeSlot(size_t slot)
+{
+    size_t next = slot, home;
+    
+    for (;;) {
+        hp_samples[slot].pOwner = NULL;
+        for (;;) {
+            next = (next + 1) % HP_SAMPLE_SLOTS;
+            if (hp_samples[next].pOwner == NULL) return;
+            home = hp_sampleHash(hp_samples[next].pOwner, hp_samples[next].id) % HP_SAMPLE_SLOTS;
+            
+            /* an entry can move back unless its home lies after the gap */
+            if ((next > slot && (home <= slot || home > next))
+                    || (next < slot && home <= slot && home > next)) {
+                break;
+            }
+        }
+        hp_samples[slot] = hp_samples[next];
+        slot = next;
+    }
+}
+
+static void hp_dropSample(size_t slot)
+{
+    struct hp_Sample* pSample = &hp_samples[slot];
+    size_t index = hp_filterIndex(pSample->pOwner, pSample->id);
+    
+    pSample->pStack->liveCount -= 1;
+    pSample->pStack->liveBytes -= pSample->size;
+    __atomic_store_n(&hp_filter[index], hp_filter[index] - 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&hp_liveCount, hp_liveCount - 1, __ATOMIC_RELAXED);
+    hp_removeSlot(slot);
+}
+
+static struct hp_Stack* hp_findStack(void** frames, int depth)
+{
+    size_t hash = 2166136261u, i;
+    int j;
+    
+    for (j = 0; j < depth; ++j) hash = (hash ^ (size_t)frames[j]) * 16777619u;
+    
+    /* sampling is rare enough for a linear search */
+    for (i = 0; i < hp_stackCount; ++i) {
+        if (hp_stacks[i].hash == hash
+                && hp_stacks[i].depth == depth
+                && memcmp(hp_stacks[i].frames, frames, (size_t)depth * sizeof(void*)) == 0) {
+            return &hp_stacks[i];
+        }
+    }
+    if (hp_stackCount == HP_MAX_STACKS) return NULL;
+    
+    hp_stacks[hp_stackCount].hash = hash;
+    hp_stacks[hp_stackCount].depth = depth;
+    memcpy(hp_stacks[hp_stackCount].frames, frames, (size_t)depth * sizeof(void*));
+    return &hp_stacks[hp_stackCount++];
+}
+
+void hp_sample(const void* pOwner, size_t id, size_t size)
+{
+    void* frames[HP_MAX_FRAMES + 1];
+    int depth;
+    size_t rate = __atomic_load_n(&hp_rate, __ATOMIC_RELAXED);
+    size_t slot, index;
+    struct hp_Stack* pStack;
+    
+    if (rate == 0) {
+        hp_armed = 0;
+        hp_countdown = HP_IDLE_BYTES;
+        return;
+    }
+    hp_countdown = hp_nextInterval(rate);
+    
+    /* a thread that was not sampling has not crossed a sampling point yet */
+    if (!hp_armed) {
+        hp_armed = 1;
+        return;
+    }
+    
+    /* skip the frame of this function */
+    depth = backtrace(frames, HP_MAX_FRAMES + 1) - 1;
+    if (depth < 0) depth = 0;
+    
+    pthread_mutex_lock(&hp_mutex);
+    
+    pStack = hp_findStack(frames + 1, depth);
+    if (pStack == NULL) goto out;
+    
+    /* an allocation that was never reported freed is dropped first */
+    slot = hp_sampleHash(pOwner, id) % HP_SAMPLE_SLOTS;
+    while (hp_samples[slot].pOwner != NULL) {
+        if (hp_samples[slot].pOwner == pOwner && hp_samples[slot].id == id) {
+            hp_dropSample(slot);
+            slot = hp_sampleHash(pOwner, id) % HP_SAMPLE_SLOTS;
+            continue;
+        }
+        slot = (slot + 1) % HP_SAMPLE_SLOTS;
+    }
+    if (hp_liveCount == HP_MAX_SAMPLES) goto out;
+    
+    hp_samples[slot].pOwner = pOwner;
+    hp_samples[slot].id = id;
+    hp_samples[slot].size = size;
+    hp_samples[slot].pStack = pStack;
+    pStack->liveCount += 1;
+    pStack->liveBytes += size;
+    pStack->allocCount += 1;
+    pStack->allocBytes += size;
+    
+    index = hp_filterIndex(pOwner, id);
+    __atomic_store_n(&hp_filter[index], hp_filter[index] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&hp_liveCount, hp_liveCount + 1, __ATOMIC_RELAXED);
+    
+out:
+    pthread_mutex_unlock(&hp_mutex);
+}
+
+void hp_forget(const void* pOwner, size_t id)
+{
+    size_t slot;
+    
+    pthread_mutex_lock(&hp_mutex);
+    slot = hp_sampleHash(pOwner, id) % HP_SAMPLE_SLOTS;
+    while (hp_samples[slot].pOwner != NULL) {
+        if (hp_samples[slot].pOwner == pOwner && hp_samples[slot].id == id) {
+            hp_dropSample(slot);
+            break;
+        }
+        slot = (slot + 1) % HP_SAMPLE_SLOTS;
+    }
+    pthread_mutex_unlock(&hp_mutex);
+}
+
+void hpForgetOwner(const void* pOwner)
+{
+    size_t slot;
+    
+    if (__atomic_load_n(&hp_liveCount, __ATOMIC_RELAXED) == 0) return;
+    pthread_mutex_lock(&hp_mutex);
+    for (slot = 0; slot < HP_SAMPLE_SLOTS; ++slot) {
+        /* removing a slot may move another entry of the owner into it */
+        while (hp_samples[slot].pOwner == pOwner && pOwner != NULL) hp_dropSample(slot);
+    }
+    pthread_mutex_unlock(&hp_mutex);
+}
+
+void hpForgetRange(const void* pOwner, size_t lo, size_t hi)
+{
+    size_t slot;
+    
+    if (lo >= hi || __atomic_load_n(&hp_liveCount, __ATOMIC_RELAXED) == 0) return;
+    pthread_mutex_lock(&hp_mutex);
+    for (slot = 0; slot < HP_SAMPLE_SLOTS; ++slot) {
+        /* removing a slot may move another entry of the range into it */
+        while (hp_samples[slot].pOwner == pOwner && pOwner != NULL
+                && hp_samples[slot].id >= lo && hp_samples[slot].id < hi) {
+            hp_dropSample(slot);
+        }
+    }
+    pthread_mutex_unlock(&hp_mutex);
+}
+
+int hpWriteProfile(FILE* pFile)
+{
+    size_t liveCount = 0, liveBytes = 0, allocCount = 0, allocBytes = 0, i;
+    char buffer[4096];
+    size_t size;
+    FILE* pMaps;
+    int j;
+    
+    pthread_mutex_lock(&hp_mutex);
+    for (i = 0; i < hp_stackCount; ++i) {
+        liveCount += hp_stacks[i].liveCount;
+        liveBytes += hp_stacks[i].liveBytes;
+        allocCount += hp_stacks[i].allocCount;
+        allocBytes += hp_stacks[i].allocBytes;
+    }
+    fprintf(pFile, "heap profile: %6lu: %8lu [%6lu: %8lu] @ heap_v2/%lu\n",
+        (unsigned long)liveCount, (unsigned long)liveBytes,
+        (unsigned long)allocCount, (unsigned long)allocBytes,
+        (unsigned long)__atomic_load_n(&hp_rate, __ATOMIC_RELAXED));
+    for (i = 0; i < hp_stackCount; ++i) {
+        fprintf(pFile, "%6lu: %8lu [%6lu: %8lu] @",
+            (unsigned long)hp_stacks[i].liveCount, (unsigned long)hp_stacks[i].liveBytes,
+            (unsigned long)hp_stacks[i].allocCount, (unsigned long)hp_stacks[i].allocBytes);
+        for (j = 0; j < hp_stacks[i].depth; ++j) {
+            fprintf(pFile, " 0x%lx", (unsigned long)(size_t)hp_stacks[i].frames[j]);
+        }
+        fputc('\n', pFile);
+    }
+    pthread_mutex_unlock(&hp_mutex);
+    
+    /* pprof needs the mappings to find the symbols of the addresses */
+    fputs("\nMAPPED_LIBRARIES:\n", pFile);
+    pMaps = fopen("/proc/self/maps", "r");
+    if (pMaps != NULL) {
+        while ((size = fread(buffer, 1, sizeof buffer, pMaps)) != 0) {
+            fwrite(buffer, 1, size, pFile);
+        }
+        fclose(pMaps);
+    }
+    return !ferror(pFile);
+}
+
+#endif /* HEAP_PROFILER_IMPLEMENTATION */
+
+/*
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+
+*/
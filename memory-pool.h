@@ -64,6 +64,55 @@ Notes:
     previously allocated handles are invalid. The pool can then be used again 
     to allocate new handles.
     
+    `mpPrefetch(pPool, handle)` hints to the CPU that the object behind a 
+    handle is about to be accessed. It never faults, even on an invalid handle, 
+    and compiles to nothing on compilers without a prefetch intrinsic.
+    
+    `mpGather(pPool, pHandles, n, pOut)` copies the `n` objects whose handles 
+    are in `pHandles` into the array `pOut`, in order. It prefetches a few 
+    handles ahead of the copy, so the cache misses of a batch overlap instead 
+    of being paid one after another. All handles must be valid.
+    
+    `mpCopyPool(pDst, pSrc)` turns `pDst` into an independent, point-in-time 
+    copy of `pSrc`: every handle valid in `pSrc` is valid in `pDst` and refers 
+    to a copy of the same object. Both pools must be of the same type. Only 
+    the part of `pSrc` that has ever been handed out is copied, and `pDst` 
+    only grows if it is too small to hold it, so that taking copies into the 
+    same pool again and again does not reallocate. The source is only read, 
+    so a reader may take a copy while holding the same lock it would need to 
+    read the pool, and then work on the copy at leisure. `mpCopyPool` returns 
+    0 on success and -1 in an out-of-memory situation, in which case `pDst` 
+    is not altered.
+    
+    `mpCopyPool` is a full, synchronous copy, and there is no copy-on-write 
+    snapshot of a pool: a pool is a single array that `mpAt` indexes 
+    directly, so its pages cannot be shared with a copy without trapping the 
+    writes to them. The copy is a single `memcpy` of every object ever handed 
+    out, and whoever holds the lock for its duration is held up for time 
+    proportional to the high-water mark of the source pool, however few 
+    objects are live in it.
+    
+    If objects have a small, frequently accessed part and a large, rarely 
+    accessed one, a `MemPoolSplit` keeps the two parts in separate arrays 
+    under the same handle, so that scanning the hot parts does not pull the 
+    cold parts into cache:
+        
+        MemPoolSplit(MyHeader, MyPayload) pool = mpsInit(&pool);
+        size_t handle = mpsAlloc(&pool);
+        mpsHot(&pool, handle).flags = 0;
+        mpsCold(&pool, handle).bytes[0] = 0;
+        mpsFree(&pool, handle);
+        mpsFreePool(&pool);
+    
+    `mpsGrowPool`, `mpsFreePool`, `mpsAlloc`, `mpsFree` and `mpsCapacity` 
+    behave like their `mp` counterparts, and both arrays always grow together. 
+    `mpsHot` and `mpsCold` expand out to lvalues like `mpAt` does.
+    
+    Allocations and frees can be reported to a profiler, such as 
+    heap_profiler.h, by defining `MP_ON_ALLOC(pPool, handle, size)`, 
+    `MP_ON_FREE(pPool, handle)` and `MP_ON_FREE_POOL(pPool)` before including 
+    the implementation. By default, they expand to nothing.
+    
     Identifiers defined by this library suffixed by an underscore (`_`) are for 
     internal use only. Your code should not contain any of them.
     
@@ -111,11 +160,69 @@ union {                     \
 #define mpFreePool(pPool)        mpFreePool_(&(pPool)->pool_)
 #define mpAlloc(pPool)           mpAlloc_(&(pPool)->pool_)
 #define mpFree(pPool, handle)    mpFree_(&(pPool)->pool_, (handle))
+#define mpCopyPool(pDst, pSrc)   mpCopyPool_(&(pDst)->pool_, &(pSrc)->pool_)
+
+#define mpPrefetch(pPool, handle)   mpPrefetch_((pPool)->pBlocks_ + (handle))
+#define mpGather(pPool, pHandles, n, pOut) \
+    mpGather_(&(pPool)->pool_, (pHandles), (n), (pOut), sizeof(*(pOut)))
+
+#if defined(__GNUC__) || defined(__clang__)
+#define mpPrefetch_(ptr)    __builtin_prefetch(ptr)
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <xmmintrin.h>
+#define mpPrefetch_(ptr)    _mm_prefetch((const char*)(ptr), _MM_HINT_T0)
+#else
+#define mpPrefetch_(ptr)    ((void)0)
+#endif
 
 int     mpGrowPool_ (struct MemPool_* this, size_t num);
 void    mpFreePool_ (struct MemPool_* this);
 size_t  mpAlloc_    (struct MemPool_* this);
 void    mpFree_     (struct MemPool_* this, size_t handle);
+int     mpCopyPool_ (struct MemPool_* this, const struct MemPool_* other);
+void    mpGather_   (const struct MemPool_* this, const size_t* pHandles,
+                     size_t n, void* pOut, size_t size);
+
+struct MemPoolSplit_ {
+    union {
+        size_t  next;
+    } *pHot;
+    void*   pCold;
+    size_t  capacity;
+    size_t  hFreeArray;
+    size_t  hFreeList;
+    size_t  hotSize;
+    size_t  coldSize;
+};
+
+#define MemPoolSplit(hotType, coldType) \
+union {                                 \
+    struct MemPoolSplit_ pool_;         \
+    struct {                            \
+        union {                         \
+            size_t  next;               \
+            hotType value;              \
+        } *pHot_;                       \
+        coldType *pCold_;               \
+    } arrays_;                          \
+}
+
+#define mpsInit(pPool)          {{NULL, NULL, 0, 0, -1, \
+                                  sizeof(*(pPool)->arrays_.pHot_), \
+                                  sizeof(*(pPool)->arrays_.pCold_)}}
+#define mpsHot(pPool, handle)   ((pPool)->arrays_.pHot_[handle].value)
+#define mpsCold(pPool, handle)  ((pPool)->arrays_.pCold_[handle])
+#define mpsCapacity(pPool)      ((const size_t)(pPool)->pool_.capacity)
+
+#define mpsGrowPool(pPool, num)  mpsGrowPool_(&(pPool)->pool_, (num))
+#define mpsFreePool(pPool)       mpsFreePool_(&(pPool)->pool_)
+#define mpsAlloc(pPool)          mpsAlloc_(&(pPool)->pool_)
+#define mpsFree(pPool, handle)   mpsFree_(&(pPool)->pool_, (handle))
+
+int     mpsGrowPool_(struct MemPoolSplit_* this, size_t num);
+void    mpsFreePool_(struct MemPoolSplit_* this);
+size_t  mpsAlloc_   (struct MemPoolSplit_* this);
+void    mpsFree_    (struct MemPoolSplit_* this, size_t handle);
 
 #define MP_INVALID_HANDLE ((size_t)(-1))
 
@@ -126,6 +233,21 @@ void    mpFree_     (struct MemPool_* this, size_t handle);
 #ifdef MEMORY_POOL_IMPLEMENTATION
 
 #include <stdlib.h>
+#include <string.h>
+
+/*  Hooks for profilers such as heap_profiler.h, which may be defined before 
+ *  the implementation is included. `pPool` is the `struct MemPool_` or 
+ *  `struct MemPoolSplit_` of the pool.
+ */
+#ifndef MP_ON_ALLOC
+#define MP_ON_ALLOC(pPool, handle, size)    ((void)0)
+#endif
+#ifndef MP_ON_FREE
+#define MP_ON_FREE(pPool, handle)           ((void)0)
+#endif
+#ifndef MP_ON_FREE_POOL
+#define MP_ON_FREE_POOL(pPool)              ((void)0)
+#endif
 
 static int mpResize_(struct MemPool_* this, size_t capacity)
 {
@@ -143,6 +265,22 @@ static size_t* mpNext_(struct MemPool_* this, size_t handle)
     return (size_t*)((char*)this->pBlocks + handle * this->blockSize);
 }
 
+/* the capacity a full pool grows to, or 0 if it cannot grow any further */
+static size_t mpNextCapacity_(size_t capacity)
+{
+    size_t newCapacity = capacity * 3 / 2;
+    if (newCapacity < capacity) {
+        return 0;
+    }
+    if (newCapacity == capacity) {
+        newCapacity += 1;
+    }
+    return newCapacity;
+}
+
+/* how many handles `mpGather_` prefetches ahead of the one it copies */
+#define MP_GATHER_DISTANCE_ 8
+
 int mpGrowPool_(struct MemPool_* this, size_t num)
 {
     size_t newCapacity = this->capacity + num;
@@ -154,6 +292,7 @@ int mpGrowPool_(struct MemPool_* this, size_t num)
 
 void mpFreePool_(struct MemPool_* this)
 {
+    MP_ON_FREE_POOL(this);
     if (this->pBlocks != NULL) {
         free(this->pBlocks);
         this->pBlocks = NULL;
@@ -168,31 +307,148 @@ size_t mpAlloc_(struct MemPool_* this)
     size_t handle = this->hFreeList;
     if (handle != MP_INVALID_HANDLE) {
         this->hFreeList = *mpNext_(this, handle);
+        MP_ON_ALLOC(this, handle, this->blockSize);
         return handle;
     }
     if (this->hFreeArray >= this->capacity) {
-        size_t newCapacity = this->capacity * 3 / 2;
-        if (newCapacity < this->capacity) {
+        size_t newCapacity = mpNextCapacity_(this->capacity);
+        if (newCapacity == 0) {
             return MP_INVALID_HANDLE;
         }
-        if (newCapacity == this->capacity) {
-            newCapacity += 1;
-        }
         if (mpResize_(this, newCapacity) != 0) {
             return MP_INVALID_HANDLE;
         }
     }
     handle = this->hFreeArray;
     this->hFreeArray += 1;
+    MP_ON_ALLOC(this, handle, this->blockSize);
     return handle;
 }
 
 void mpFree_(struct MemPool_* this, size_t handle)
 {
+    MP_ON_FREE(this, handle);
     *mpNext_(this, handle) = this->hFreeList;
     this->hFreeList = handle;
 }
 
+int mpCopyPool_(struct MemPool_* this, const struct MemPool_* other)
+{
+    if (other->hFreeArray == 0) {
+        mpFreePool_(this);
+        return 0;
+    }
+    if (this->capacity < other->hFreeArray) {
+        if (mpResize_(this, other->hFreeArray) != 0) {
+            return -1;
+        }
+    }
+    /* the handles of `this` are replaced by those of `other` */
+    MP_ON_FREE_POOL(this);
+    memcpy(this->pBlocks, other->pBlocks, other->hFreeArray * other->blockSize);
+    this->hFreeArray = other->hFreeArray;
+    this->hFreeList = other->hFreeList;
+    return 0;
+}
+
+void mpGather_(const struct MemPool_* this, const size_t* pHandles,
+               size_t n, void* pOut, size_t size)
+{
+    const char* pBlocks = (const char*)this->pBlocks;
+    char* pDst = pOut;
+    size_t i;
+    for (i = 0; i < n && i < MP_GATHER_DISTANCE_; ++i) {
+        mpPrefetch_(pBlocks + pHandles[i] * this->blockSize);
+    }
+    for (i = 0; i < n; ++i) {
+        if (i + MP_GATHER_DISTANCE_ < n) {
+            mpPrefetch_(pBlocks + pHandles[i + MP_GATHER_DISTANCE_] * this->blockSize);
+        }
+        memcpy(pDst, pBlocks + pHandles[i] * this->blockSize, size);
+        pDst += size;
+    }
+}
+
+/*  The cold array is resized first. If the hot array then fails to resize, 
+ *  the cold array is merely larger than it needs to be, and the pool is left 
+ *  as it was.
+ */
+static int mpsResize_(struct MemPoolSplit_* this, size_t capacity)
+{
+    void* temp = realloc(this->pCold, capacity * this->coldSize);
+    if (temp == NULL) {
+        return -1;
+    }
+    this->pCold = temp;
+    temp = realloc(this->pHot, capacity * this->hotSize);
+    if (temp == NULL) {
+        return -1;
+    }
+    this->pHot = temp;
+    this->capacity = capacity;
+    return 0;
+}
+
+static size_t* mpsNext_(struct MemPoolSplit_* this, size_t handle)
+{
+    return (size_t*)((char*)this->pHot + handle * this->hotSize);
+}
+
+int mpsGrowPool_(struct MemPoolSplit_* this, size_t num)
+{
+    size_t newCapacity = this->capacity + num;
+    if (newCapacity < this->capacity) {
+        return -1;
+    }
+    return mpsResize_(this, newCapacity);
+}
+
+void mpsFreePool_(struct MemPoolSplit_* this)
+{
+    MP_ON_FREE_POOL(this);
+    if (this->pHot != NULL) {
+        free(this->pHot);
+        this->pHot = NULL;
+    }
+    if (this->pCold != NULL) {
+        free(this->pCold);
+        this->pCold = NULL;
+    }
+    this->capacity = 0;
+    this->hFreeArray = 0;
+    this->hFreeList = MP_INVALID_HANDLE;
+}
+
+size_t mpsAlloc_(struct MemPoolSplit_* this)
+{
+    size_t handle = this->hFreeList;
+    if (handle != MP_INVALID_HANDLE) {
+        this->hFreeList = *mpsNext_(this, handle);
+        MP_ON_ALLOC(this, handle, this->hotSize + this->coldSize);
+        return handle;
+    }
+    if (this->hFreeArray >= this->capacity) {
+        size_t newCapacity = mpNextCapacity_(this->capacity);
+        if (newCapacity == 0) {
+            return MP_INVALID_HANDLE;
+        }
+        if (mpsResize_(this, newCapacity) != 0) {
+            return MP_INVALID_HANDLE;
+        }
+    }
+    handle = this->hFreeArray;
+    this->hFreeArray += 1;
+    MP_ON_ALLOC(this, handle, this->hotSize + this->coldSize);
+    return handle;
+}
+
+void mpsFree_(struct MemPoolSplit_* this, size_t handle)
+{
+    MP_ON_FREE(this, handle);
+    *mpsNext_(this, handle) = this->hFreeList;
+    this->hFreeList = handle;
+}
+
 #endif /* MEMORY_POOL_IMPLEMENTATION */
 
 /*
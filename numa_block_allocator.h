@@ -0,0 +1,311 @@
+/*
+numa_block_allocator.h - public domain - github.com/cofinite
+
+In exactly one source file, put:
+    #define NUMA_BLOCK_ALLOCATOR_IMPLEMENTATION
+    #include "numa_block_allocator.h"
+
+Other source or header files should have just:
+    #include "numa_block_allocator.h"
+
+This library is built on fixed_size_block_allocator.h and page_memory.h, which
+must be available to include, and whose implementations must be compiled in
+some source file. `FSBA_ATOMIC` must be defined wherever
+fixed_size_block_allocator.h is included.
+
+
+The purpose of this library is to keep fixed-size blocks on the NUMA node of
+the thread that allocates them. On machines with several nodes, memory on
+another node is slower to reach, and a single allocator hands out blocks from
+wherever its memory happens to lie.
+
+A NUMA block allocator keeps one atomic `FsbaAllocator` per node, in memory
+bound to that node:
+
+    NbaAllocator* allocator = nbaCreateAllocator((size_t)1 << 30, 64, 16, PM_POPULATE);
+
+`nbaAllocate` allocates from the node of the calling thread, and from the other
+nodes once that one is out of blocks. `nbaFree` returns a block to the node it
+came from, whichever thread frees it:
+
+    MyObjectType* obj = nbaAllocate(allocator);
+    nbaFree(allocator, obj);
+
+    nbaDestroyAllocator(allocator);
+
+Finding the node of the calling thread takes a system call. Threads that are
+pinned to a node can find it once, with `pmCurrentNode`, and pass it to
+`nbaAllocateOnNode`.
+
+The flags are those of `pmMap`. With `PM_POPULATE`, the memory of every node is
+backed after it has been bound, so it is placed even where binding is not
+available, as long as the calling thread runs on the node in question. On a
+machine with a single node, or where the nodes cannot be found out, a NUMA
+block allocator is a single atomic allocator.
+
+A NUMA block allocator can be shared by any number of threads.
+
+LICENSE
+
+See end of file for license information.
+
+*/
+
+#ifndef NBA_INCLUDE_NUMA_BLOCK_ALLOCATOR_H
+#define NBA_INCLUDE_NUMA_BLOCK_ALLOCATOR_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! @brief The most nodes a NUMA block allocator spreads over. */
+#define NBA_MAX_NODES 64
+
+/*! @brief Opaque allocator object.
+ *  
+ *  Opaque allocator object.
+ */
+typedef struct NbaAllocator NbaAllocator;
+
+/*! @brief Creates a NUMA block allocator.
+ *  
+ *  This function maps memory of the given size on every node, and emplaces a
+ *  fixed-size block allocator in each.
+ *  
+ *  @param[in] memSizePerNode The size of the memory of every node.
+ *  
+ *  @param[in] blockSize The size of the blocks.
+ *  
+ *  @param[in] blockAlign The alignment of the blocks.
+ *  
+ *  @param[in] flags Zero or more of `PM_POPULATE` and `PM_HUGE_PAGES`.
+ *  
+ *  @return A handle to the allocator, or `NULL` if memory could not be mapped
+ *  or does not hold a single block.
+ */
+NbaAllocator* nbaCreateAllocator(size_t memSizePerNode, size_t blockSize, size_t blockAlign, int flags);
+
+/*! @brief Destroys a NUMA block allocator.
+ *  
+ *  This function unmaps the memory of the allocator, along with all blocks
+ *  that are still allocated from it.
+ *  
+ *  @param[in] pAllocator Handle to the allocator, or `NULL`.
+ */
+void nbaDestroyAllocator(NbaAllocator* pAllocator);
+
+/*! @brief Allocates a block on the node of the calling thread.
+ *  
+ *  @param[in] pAllocator Handle to the allocator from which to request the
+ *  block.
+ *  
+ *  @return A pointer to the block, or `NULL` if no node has a block left.
+ */
+void* nbaAllocate(NbaAllocator* pAllocator);
+
+/*! @brief Allocates a block on the given node.
+ *  
+ *  This function allocates a block on the given node, or on another node if
+ *  that one is out of blocks.
+ *  
+ *  @param[in] pAllocator Handle to the allocator from which to request the
+ *  block.
+ *  
+ *  @param[in] node The preferred node. Nodes the allocator does not have are
+ *  wrapped around.
+ *  
+ *  @return A pointer to the block, or `NULL` if no node has a block left.
+ */
+void* nbaAllocateOnNode(NbaAllocator* pAllocator, unsigned node);
+
+/*! @brief Frees a block.
+ *  
+ *  This function returns a block to the node it was allocated on.
+ *  
+ *  @param[in] pAllocator Handle to the allocator from which the block was
+ *  previously requested.
+ *  
+ *  @param[in] pBlock Pointer to the block to be freed, or `NULL`.
+ */
+void nbaFree(NbaAllocator* pAllocator, void* pBlock);
+
+/*! @brief Returns the number of nodes of an allocator.
+ *  
+ *  @param[in] pAllocator Handle to the allocator.
+ *  
+ *  @return The number of nodes the allocator has memory on.
+ */
+unsigned nbaNodeCount(const NbaAllocator* pAllocator);
+
+/*! @brief Returns the node a block was allocated on.
+ *  
+ *  @param[in] pAllocator Handle to the allocator.
+ *  
+ *  @param[in] pBlock Pointer to a block allocated from `pAllocator`.
+ *  
+ *  @return The node of the block, or `nbaNodeCount(pAllocator)` if the block
+ *  does not belong to the allocator.
+ */
+unsigned nbaNodeOf(const NbaAllocator* pAllocator, const void* pBlock);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NBA_INCLUDE_NUMA_BLOCK_ALLOCATOR_H */
+
+
+
+#if defined(NUMA_BLOCK_ALLOCATOR_IMPLEMENTATION) && !defined(NUMA_BLOCK_ALLOCATOR_IMPLEMENTATION_INCLUDED)
+#define NUMA_BLOCK_ALLOCATOR_IMPLEMENTATION_INCLUDED
+
+#include "fixed_size_block_allocator.h"
+#include "page_memory.h"
+
+#ifndef FSBA_ATOMIC
+#error "numa_block_allocator.h requires FSBA_ATOMIC"
+#endif
+
+struct nba_Node {
+    void* pMem;
+    FsbaAllocator* pBlocks;
+};
+
+struct NbaAllocator {
+    size_t memSize;
+    unsigned nodeCount;
+    struct nba_Node nodes[NBA_MAX_NODES];
+};
+
+NbaAllocator* nbaCreateAllocator(size_t memSizePerNode, size_t blockSize, size_t blockAlign, int flags)
+{
+    NbaAllocator* pAllocator;
+    unsigned node;
+    void* pMem;
+    
+    pAllocator = (NbaAllocator*)pmMap(sizeof(NbaAllocator), 0);
+    if (pAllocator == NULL) return NULL;
+    
+    pAllocator->memSize = memSizePerNode;
+    pAllocator->nodeCount = pmNodeCount();
+    if (pAllocator->nodeCount > NBA_MAX_NODES) pAllocator->nodeCount = NBA_MAX_NODES;
+    
+    for (node = 0; node < pAllocator->nodeCount; ++node) {
+        /*  Populating has to wait until the memory is bound, or its pages
+         *  would come from the node of the calling thread. If binding fails,
+         *  for instance because the node is offline, the memory is still used,
+         *  only from wherever its pages end up.
+         */
+        pMem = pmMap(memSizePerNode, flags & ~PM_POPULATE);
+        if (pMem == NULL) goto out_of_memory;
+        pmBindToNode(pMem, memSizePerNode, node);
+        if (flags & PM_POPULATE) pmPrefault(pMem, memSizePerNode, 1);
+        
+        pAllocator->nodes[node].pMem = pMem;
+        pAllocator->nodes[node].pBlocks = fsbaEmplaceAllocator(pMem, memSizePerNode, blockSize, blockAlign, NULL);
+        if (pAllocator->nodes[node].pBlocks == NULL) {
+            pmUnmap(pMem, memSizePerNode);
+            goto out_of_memory;
+        }
+    }
+    
+    return pAllocator;
+    
+out_of_memory:
+    pAllocator->nodeCount = node;
+    nbaDestroyAllocator(pAllocator);
+    return NULL;
+}
+
+void nbaDestroyAllocator(NbaAllocator* pAllocator)
+{
+    unsigned node;
+    
+    if (pAllocator == NULL) return;
+    for (node = 0; node < pAllocator->nodeCount; ++node) {
+        pmUnmap(pAllocator->nodes[node].pMem, pAllocator->memSize);
+    }
+    pmUnmap(pAllocator, sizeof(NbaAllocator));
+}
+
+void* nbaAllocate(NbaAllocator* pAllocator)
+{
+    /* a single node needs no system call to find it */
+    if (pAllocator->nodeCount == 1) return fsbaAllocate(pAllocator->nodes[0].pBlocks);
+    return nbaAllocateOnNode(pAllocator, pmCurrentNode());
+}
+
+void* nbaAllocateOnNode(NbaAllocator* pAllocator, unsigned node)
+{
+    void* pBlock;
+    unsigned i;
+    
+    node %= pAllocator->nodeCount;
+    pBlock = fsbaAllocate(pAllocator->nodes[node].pBlocks);
+    if (pBlock != NULL) return pBlock;
+    
+    /* spill over to the other nodes, nearest number first */
+    for (i = 1; i < pAllocator->nodeCount; ++i) {
+        pBlock = fsbaAllocate(pAllocator->nodes[(node + i) % pAllocator->nodeCount].pBlocks);
+        if (pBlock != NULL) return pBlock;
+    }
+    return NULL;
+}
+
+void nbaFree(NbaAllocator* pAllocator, void* pBlock)
+{
+    unsigned node;
+    
+    if (pBlock == NULL) return;
+    node = nbaNodeOf(pAllocator, pBlock);
+    if (node < pAllocator->nodeCount) fsbaFree(pAllocator->nodes[node].pBlocks, pBlock);
+}
+
+unsigned nbaNodeCount(const NbaAllocator* pAllocator)
+{
+    return pAllocator->nodeCount;
+}
+
+unsigned nbaNodeOf(const NbaAllocator* pAllocator, const void* pBlock)
+{
+    unsigned node;
+    
+    /* nodes are few, so a linear search beats anything cleverer */
+    for (node = 0; node < pAllocator->nodeCount; ++node) {
+        if (fsbaOwns(pAllocator->nodes[node].pBlocks, pBlock)) break;
+    }
+    return node;
+}
+
+#endif /* NUMA_BLOCK_ALLOCATOR_IMPLEMENTATION */
+
+/*
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+
+*/
@@ -0,0 +1,480 @@
+/*
+page_memory.h - public domain - github.com/cofinite
+
+In exactly one source file, put:
+    #define PAGE_MEMORY_IMPLEMENTATION
+    #include "page_memory.h"
+
+Other source or header files should have just:
+    #include "page_memory.h"
+
+
+The purpose of this library is to get memory from the operating system ready
+for the allocators of this repository before it is used. The allocators take
+memory from the user and do not care where it comes from, but memory mapped
+from the system is only backed by pages on first touch, so the first
+allocation from every page takes a page fault in the middle of the hot path.
+This library moves those faults to start-up.
+
+To map memory, call `pmMap` with the size and any of the following flags:
+
++ `PM_POPULATE` backs every page before `pmMap` returns
++ `PM_HUGE_PAGES` aligns the memory to huge pages and asks for it to be backed
+  by them, which also cuts the number of TLB misses when blocks are spread
+  over a large region
+
+    size_t size = (size_t)1 << 30;
+    void* mem = pmMap(size, PM_POPULATE | PM_HUGE_PAGES);
+    FsbaAllocator* allocator = fsbaEmplaceAllocator(mem, size, 64, 16, NULL);
+
+    ...
+
+    pmUnmap(mem, size);
+
+Memory obtained elsewhere, including memory that an allocator has already been
+emplaced in, can be backed with `pmPrefault`. Large regions take a while to
+fault in on one core; `pmPrefault` can split the work between threads:
+
+    pmPrefault(mem, size, 8);
+
+On machines with several NUMA nodes, memory can be placed on a given node by
+binding it before it is first touched:
+
+    void* mem = pmMap(size, 0);
+    pmBindToNode(mem, size, pmCurrentNode());
+    pmPrefault(mem, size, 8);
+
+The nodes are read from `/sys/devices/system/node` and bound with the `mbind`
+system call, so no libnuma is needed. Where either is missing, the machine is
+taken to have one node, and binding fails.
+
+Pages that are no longer used can be handed back with `pmRelease`, which keeps
+them mapped, so that an allocator can go on using them later.
+
+Huge pages are a request, not a guarantee: without transparent huge pages, or
+when the system is short of them, the memory is backed by ordinary pages.
+
+This library needs POSIX, and threads for `pmPrefault`; link with `-pthread`.
+On Linux, `MAP_ANONYMOUS` and `madvise` are only declared with `_DEFAULT_SOURCE`
+or `_GNU_SOURCE` defined, before any system header is included, when compiling
+with `-std=c89` or `-std=c99`.
+
+LICENSE
+
+See end of file for license information.
+
+*/
+
+#ifndef PM_INCLUDE_PAGE_MEMORY_H
+#define PM_INCLUDE_PAGE_MEMORY_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! @brief Flag for `pmMap` to back every page before returning. */
+#define PM_POPULATE 1
+
+/*! @brief Flag for `pmMap` to ask for huge pages. */
+#define PM_HUGE_PAGES 2
+
+/*! @brief Returns the size of a page.
+ *  
+ *  @return The size of an ordinary page, in bytes.
+ */
+size_t pmPageSize(void);
+
+/*! @brief Maps memory from the system.
+ *  
+ *  This function maps private, zeroed, readable and writable memory of at
+ *  least the given size, aligned to a page, or to a huge page with
+ *  `PM_HUGE_PAGES`.
+ *  
+ *  @param[in] size The size of the memory to map.
+ *  
+ *  @param[in] flags Zero or more of `PM_POPULATE` and `PM_HUGE_PAGES`.
+ *  
+ *  @return A pointer to the memory, or `NULL` if it could not be mapped.
+ */
+void* pmMap(size_t size, int flags);
+
+/*! @brief Unmaps memory.
+ *  
+ *  This function returns memory that has previously been returned by a call to
+ *  `pmMap` to the system.
+ *  
+ *  @param[in] pMem Pointer to the memory to unmap, or `NULL`.
+ *  
+ *  @param[in] size The size that was passed to `pmMap`.
+ */
+void pmUnmap(void* pMem, size_t size);
+
+/*! @brief Backs memory by pages.
+ *  
+ *  This function touches every page of the given memory, so that later
+ *  accesses do not fault. The contents of the memory are not changed, so it
+ *  may already be in use, but not by other threads while this function runs.
+ *  
+ *  @param[in] pMem Pointer to the memory.
+ *  
+ *  @param[in] size The size of the memory.
+ *  
+ *  @param[in] threadCount The number of threads to spread the work over. With
+ *  0 or 1, all pages are touched by the calling thread. Falls back to the
+ *  calling thread if threads cannot be created.
+ */
+void pmPrefault(void* pMem, size_t size, unsigned threadCount);
+
+/*! @brief Hands pages back to the system.
+ *  
+ *  This function drops the contents of the given pages and the memory backing
+ *  them. The pages stay mapped, and read as zeros, or on some systems as their
+ *  old contents, until they are written to. Pages only partly inside the
+ *  given memory are left alone.
+ *  
+ *  The signature fits `fsbaBitmapSetPageRelease`.
+ *  
+ *  @param[in] pMem Pointer to the memory.
+ *  
+ *  @param[in] size The size of the memory.
+ */
+void pmRelease(void* pMem, size_t size);
+
+/*! @brief Returns the number of NUMA nodes.
+ *  
+ *  @return One more than the highest online node number, or 1 if the nodes
+ *  cannot be found out.
+ */
+unsigned pmNodeCount(void);
+
+/*! @brief Returns the NUMA node of the calling thread.
+ *  
+ *  This function returns the node of the CPU the calling thread is running
+ *  on. This takes a system call; threads pinned to a node should call it once
+ *  and keep the result.
+ *  
+ *  @return The node number, or 0 if it cannot be found out.
+ */
+unsigned pmCurrentNode(void);
+
+/*! @brief Binds memory to a NUMA node.
+ *  
+ *  This function makes the pages of the given memory come from the given
+ *  node. Pages that are already backed are not moved, so this should be called
+ *  before the memory is touched.
+ *  
+ *  @param[in] pMem Pointer to the memory, aligned to a page.
+ *  
+ *  @param[in] size The size of the memory.
+ *  
+ *  @param[in] node The node number, less than `pmNodeCount()`.
+ *  
+ *  @return Nonzero if the memory was bound, zero otherwise.
+ */
+int pmBindToNode(void* pMem, size_t size, unsigned node);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PM_INCLUDE_PAGE_MEMORY_H */
+
+
+
+#if defined(PAGE_MEMORY_IMPLEMENTATION) && !defined(PAGE_MEMORY_IMPLEMENTATION_INCLUDED)
+#define PAGE_MEMORY_IMPLEMENTATION_INCLUDED
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <limits.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+/* the size huge pages are aligned to; 2 MiB on x86-64, and on ARM64 with 4K pages */
+#define PM_HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+/* regions smaller than this are not worth starting a thread for */
+#define PM_MIN_PREFAULT_CHUNK ((size_t)16 << 20)
+
+/* from <linux/mempolicy.h>, which would drag in kernel headers */
+#define PM_MPOL_BIND 2
+
+/* the most nodes `pmBindToNode` can bind to */
+#define PM_MAX_NODES 1024
+
+struct pm_Range {
+    char* pBegin;
+    char* pEnd;
+    size_t pageSize;
+};
+
+static size_t pm_pageSize = 4096;
+static pthread_once_t pm_pageSizeOnce = PTHREAD_ONCE_INIT;
+
+/* run once, as the prefault threads ask for the page size too */
+static void pm_findPageSize(void)
+{
+    long result = sysconf(_SC_PAGESIZE);
+    if (result > 0) pm_pageSize = (size_t)result;
+}
+
+size_t pmPageSize(void)
+{
+    pthread_once(&pm_pageSizeOnce, pm_findPageSize);
+    return pm_pageSize;
+}
+
+static size_t pm_roundUp(size_t num, size_t pow2)
+{
+    return (num + pow2 - 1) & ~(pow2 - 1);
+}
+
+static void pm_touch(struct pm_Range* pRange)
+{
+    char* pPage = (char*)((size_t)pRange->pBegin & ~(pRange->pageSize - 1));
+    volatile char* pByte;
+    
+    /*  Write rather than read, as reading an untouched page maps the shared
+     *  zero page instead of backing it.
+     */
+    for (; pPage < pRange->pEnd; pPage += pRange->pageSize) {
+        pByte = pPage < pRange->pBegin ? pRange->pBegin : pPage;
+        *pByte = *pByte;
+    }
+}
+
+static void* pm_touchThread(void* pRange)
+{
+    pm_touch((struct pm_Range*)pRange);
+    return NULL;
+}
+
+void* pmMap(size_t size, int flags)
+{
+    size_t mappedSize, extraSize;
+    char* pMem;
+    char* pAligned;
+    int mmapFlags = MAP_PRIVATE | MAP_ANONYMOUS;
+    
+    if (size == 0) return NULL;
+    mappedSize = pm_roundUp(size, pmPageSize());
+    if (mappedSize < size) return NULL;
+    
+    /*  mmap only aligns to ordinary pages, so for huge pages map one huge page
+     *  more than needed and cut off what lies outside the aligned range.
+     *  Populating has to wait until after the madvise, or the memory would
+     *  already be backed by ordinary pages.
+     */
+    extraSize = flags & PM_HUGE_PAGES ? PM_HUGE_PAGE_SIZE : 0;
+    if (mappedSize + extraSize < mappedSize) return NULL;
+    
+#ifdef MAP_POPULATE
+    if ((flags & (PM_POPULATE | PM_HUGE_PAGES)) == PM_POPULATE) mmapFlags |= MAP_POPULATE;
+#endif
+    
+    pMem = (char*)mmap(NULL, mappedSize + extraSize, PROT_READ | PROT_WRITE, mmapFlags, -1, 0);
+    if (pMem == (char*)MAP_FAILED) return NULL;
+    
+    pAligned = pMem;
+    if (flags & PM_HUGE_PAGES) {
+        pAligned = (char*)pm_roundUp((size_t)pMem, PM_HUGE_PAGE_SIZE);
+        if (pAligned != pMem) munmap(pMem, (size_t)(pAligned - pMem));
+        if (pAligned + mappedSize != pMem + mappedSize + extraSize) {
+            munmap(pAligned + mappedSize, (size_t)(pMem + extraSize - pAligned));
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(pAligned, mappedSize, MADV_HUGEPAGE);
+#endif
+    }
+    
+#ifdef MAP_POPULATE
+    if ((flags & (PM_POPULATE | PM_HUGE_PAGES)) == (PM_POPULATE | PM_HUGE_PAGES)) {
+        pmPrefault(pAligned, mappedSize, 1);
+    }
+#else
+    if (flags & PM_POPULATE) pmPrefault(pAligned, mappedSize, 1);
+#endif
+    
+    return pAligned;
+}
+
+void pmUnmap(void* pMem, size_t size)
+{
+    if (pMem == NULL) return;
+    
+    munmap(pMem, pm_roundUp(size, pmPageSize()));
+}
+
+void pmPrefault(void* pMem, size_t size, unsigned threadCount)
+{
+    struct pm_Range whole;
+    size_t pageSize = pmPageSize();
+    size_t pageCount, pagesPerThread;
+    unsigned i, startedCount;
+    
+    if (pMem == NULL || size == 0) return;
+    
+    /* start at the first page boundary, and include the page holding the last byte */
+    whole.pBegin = (char*)pMem;
+    whole.pEnd = (char*)pMem + size;
+    whole.pageSize = pageSize;
+    pageCount = (pm_roundUp((size_t)whole.pEnd, pageSize)
+        - ((size_t)whole.pBegin & ~(pageSize - 1))) / pageSize;
+    
+    if (threadCount > size / PM_MIN_PREFAULT_CHUNK) {
+        threadCount = (unsigned)(size / PM_MIN_PREFAULT_CHUNK);
+    }
+    if (threadCount <= 1) {
+        pm_touch(&whole);
+        return;
+    }
+    
+    {
+        pthread_t threads[64];
+        struct pm_Range ranges[64];
+        char* pPageBegin = (char*)((size_t)whole.pBegin & ~(pageSize - 1));
+    
+        if (threadCount > 64) threadCount = 64;
+        pagesPerThread = (pageCount + threadCount - 1) / threadCount;
+    
+        /* the calling thread takes the first range itself */
+        for (i = 0; i < threadCount; ++i) {
+            ranges[i].pBegin = pPageBegin + (size_t)i * pagesPerThread * pageSize;
+            ranges[i].pEnd = ranges[i].pBegin + pagesPerThread * pageSize;
+            ranges[i].pageSize = pageSize;
+            if (ranges[i].pBegin < whole.pBegin) ranges[i].pBegin = whole.pBegin;
+            if (ranges[i].pEnd > whole.pEnd) ranges[i].pEnd = whole.pEnd;
+        }
+    
+        startedCount = 1;
+        while (startedCount < threadCount) {
+            if (pthread_create(&threads[startedCount], NULL, pm_touchThread, &ranges[startedCount]) != 0) {
+                break;
+            }
+            startedCount += 1;
+        }
+    
+        pm_touch(&ranges[0]);
+        for (i = startedCount; i < threadCount; ++i) pm_touch(&ranges[i]);
+        for (i = 1; i < startedCount; ++i) pthread_join(threads[i], NULL);
+    }
+}
+
+void pmRelease(void* pMem, size_t size)
+{
+    size_t pageSize = pmPageSize();
+    size_t begin = pm_roundUp((size_t)pMem, pageSize);
+    size_t end = ((size_t)pMem + size) & ~(pageSize - 1);
+    
+    if (end > begin) madvise((void*)begin, end - begin, MADV_DONTNEED);
+}
+
+static unsigned pm_nodeCount = 1;
+static pthread_once_t pm_nodeCountOnce = PTHREAD_ONCE_INIT;
+
+/* run once, so that no caller can see the count before it is complete */
+static void pm_findNodeCount(void)
+{
+    unsigned nodeCount = 1;
+    FILE* pFile;
+    unsigned long first, last;
+    int separator;
+    
+    /* a list of ranges like "0-1,4", of which the last number is the highest */
+    pFile = fopen("/sys/devices/system/node/online", "r");
+    if (pFile == NULL) return;
+    while (fscanf(pFile, "%lu", &first) == 1) {
+        last = first;
+        separator = fgetc(pFile);
+        if (separator == '-') {
+            if (fscanf(pFile, "%lu", &last) != 1) break;
+            separator = fgetc(pFile);
+        }
+        if (last < PM_MAX_NODES && last + 1 > nodeCount) nodeCount = (unsigned)last + 1;
+        if (separator != ',') break;
+    }
+    fclose(pFile);
+    pm_nodeCount = nodeCount;
+}
+
+unsigned pmNodeCount(void)
+{
+    pthread_once(&pm_nodeCountOnce, pm_findNodeCount);
+    return pm_nodeCount;
+}
+
+unsigned pmCurrentNode(void)
+{
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu, node;
+    
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0 && node < pmNodeCount()) return node;
+#endif
+    return 0;
+}
+
+int pmBindToNode(void* pMem, size_t size, unsigned node)
+{
+#if defined(__linux__) && defined(SYS_mbind)
+    unsigned long mask[PM_MAX_NODES / (sizeof(unsigned long) * CHAR_BIT)];
+    size_t i;
+    
+    if (node >= pmNodeCount()) return 0;
+    for (i = 0; i < sizeof mask / sizeof *mask; ++i) mask[i] = 0;
+    mask[node / (sizeof(unsigned long) * CHAR_BIT)] = 1UL << (node % (sizeof(unsigned long) * CHAR_BIT));
+    
+    return syscall(SYS_mbind, pMem, pm_roundUp(size, pmPageSize()), PM_MPOL_BIND,
+        mask, (unsigned long)PM_MAX_NODES, 0U) == 0;
+#else
+    (void)pMem;
+    (void)size;
+    (void)node;
+    return 0;
+#endif
+}
+
+#undef PM_HUGE_PAGE_SIZE
+#undef PM_MIN_PREFAULT_CHUNK
+#undef PM_MPOL_BIND
+#undef PM_MAX_NODES
+
+#endif /* PAGE_MEMORY_IMPLEMENTATION */
+
+/*
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+
+*/
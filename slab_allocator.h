@@ -0,0 +1,359 @@
+/*
+slab_allocator.h - public domain - github.com/cofinite
+
+In exactly one source file, put:
+    #define SLAB_ALLOCATOR_IMPLEMENTATION
+    #include "slab_allocator.h"
+
+Other source or header files should have just:
+    #include "slab_allocator.h"
+
+This library is built on fixed_size_block_allocator.h, which must be available
+to include, and whose implementation must be compiled in some source file.
+
+
+The purpose of this library is to provide allocation of small objects of any
+size, at nearly the speed of fixed-size block allocation, for C89, in a single
+file. Like fixed_size_block_allocator.h, it does not depend on `malloc`, but
+instead takes memory from the user.
+
+To create a slab allocator, call `slabEmplaceAllocator` and pass to it some
+amount of memory:
+
+    static char mem[1 << 20];
+    SlabAllocator* allocator = slabEmplaceAllocator(mem, sizeof mem);
+
+You can then call `slabAllocate` and `slabFree` to allocate and free memory:
+
+    MyObjectType* obj = slabAllocate(allocator, sizeof *obj);
+    slabFree(allocator, obj);
+
+The memory is cut into slabs of `SLAB_SIZE` bytes, aligned to `SLAB_SIZE`.
+Every requested size is rounded up to one of a fixed table of size classes,
+found with a lookup table, and each slab hands out blocks of a single class
+from a `FsbaAllocator` emplaced at its start. Freeing finds the slab, and from
+it the class, by rounding the address of the block down to `SLAB_SIZE`, so no
+size needs to be passed to `slabFree`. Slabs whose blocks have all been freed
+go back to a common pool and may be reused for any class.
+
+Sizes up to `SLAB_MAX_SIZE` bytes are served. Larger requests fail and should
+be taken elsewhere. Blocks are aligned to the largest power of two dividing
+their class size, up to 16.
+
+`SLAB_SIZE` is 4096 by default, and may be changed by defining it to another
+power of two of at least 4096 wherever this file is included.
+
+A slab allocator must not be used by several threads at once.
+
+LICENSE
+
+See end of file for license information.
+
+*/
+
+#ifndef SLAB_INCLUDE_SLAB_ALLOCATOR_H
+#define SLAB_INCLUDE_SLAB_ALLOCATOR_H
+
+#include <stddef.h>
+
+#ifndef SLAB_SIZE
+#define SLAB_SIZE 4096
+#endif
+
+#if SLAB_SIZE < 4096 || (SLAB_SIZE & (SLAB_SIZE - 1)) != 0
+#error "SLAB_SIZE must be a power of two of at least 4096"
+#endif
+
+/*! @brief The largest size served by a slab allocator. */
+#define SLAB_MAX_SIZE 1024
+
+/*! @brief Opaque allocator object.
+ *  
+ *  Opaque allocator object.
+ */
+typedef struct SlabAllocator SlabAllocator;
+
+/*! @brief Emplaces a slab allocator in the given memory.
+ *  
+ *  This function constructs an allocator in-place within the memory passed to
+ *  it. The rest of the memory is cut into slabs from which memory is
+ *  allocated.
+ *  
+ *  The caller is responsible for the memory passed to this function. This
+ *  interface provides no destructor that would need to be called when you are
+ *  finished with the allocator.
+ *  
+ *  @param[in] pMem Pointer to the memory to be used by the allocator.
+ *  
+ *  @param[in] memSize The size of the memory pointed to by `pMem`.
+ *  
+ *  @return A handle to the allocator, or `NULL` if not given enough memory
+ *  for the allocator and at least one slab.
+ */
+SlabAllocator* slabEmplaceAllocator(void* pMem, size_t memSize);
+
+/*! @brief Allocates memory.
+ *  
+ *  This function allocates a block of memory of at least the given size.
+ *  
+ *  @param[in] pAllocator Handle to the allocator from which to request the
+ *  memory.
+ *  
+ *  @param[in] size The size of the memory to allocate, at most
+ *  `SLAB_MAX_SIZE`.
+ *  
+ *  @return A pointer to the memory, or `NULL` if the allocator is out of
+ *  memory or `size` is larger than `SLAB_MAX_SIZE`.
+ */
+void* slabAllocate(SlabAllocator* pAllocator, size_t size);
+
+/*! @brief Frees memory.
+ *  
+ *  This function frees memory that has previously been returned by a call to
+ *  `slabAllocate`.
+ *  
+ *  @param[in] pAllocator Handle to the allocator from which the memory was
+ *  previously requested.
+ *  
+ *  @param[in] pBlock Pointer to the memory to be freed, or `NULL`.
+ *  This must have been previously returned by a call to `slabAllocate`, using
+ *  the same allocator.
+ */
+void slabFree(SlabAllocator* pAllocator, void* pBlock);
+
+/*! @brief Returns the usable size of allocated memory.
+ *  
+ *  This function returns the size of the class that a block of memory was
+ *  allocated from, which may be larger than the size that was requested.
+ *  
+ *  @param[in] pBlock Pointer to memory returned by a call to `slabAllocate`.
+ *  
+ *  @return The number of bytes that may be used at `pBlock`.
+ */
+size_t slabUsableSize(const void* pBlock);
+
+#endif /* SLAB_INCLUDE_SLAB_ALLOCATOR_H */
+
+
+
+#ifdef SLAB_ALLOCATOR_IMPLEMENTATION
+
+#include "fixed_size_block_allocator.h"
+
+/*  Size classes: multiples of 16 up to 128, then four classes per doubling.
+ *  8 is there for pointer-sized objects. The spacing keeps internal
+ *  fragmentation under 25% while the number of classes, and with it the
+ *  number of partially used slabs, stays small.
+ */
+static const unsigned short slab_classSizes[] = {
+    8, 16, 32, 48, 64, 80, 96, 112, 128,
+    160, 192, 224, 256,
+    320, 384, 448, 512,
+    640, 768, 896, 1024
+};
+
+#define SLAB_CLASS_COUNT \
+    (sizeof slab_classSizes / sizeof *slab_classSizes)
+
+/* the lookup table maps sizes, in steps of 8 bytes, to classes */
+#define SLAB_LOOKUP_SIZE (SLAB_MAX_SIZE / 8 + 1)
+
+/* header at the beginning of every slab */
+struct slab_Slab {
+    struct slab_Slab* pPrev;
+    struct slab_Slab* pNext;
+    FsbaAllocator* pBlocks;
+    size_t classIndex;
+    size_t liveCount;
+    size_t blockCount;
+};
+
+struct slab_Class {
+    struct slab_Slab* pPartial; /* slabs with free blocks, doubly linked */
+};
+
+struct SlabAllocator {
+    char* pFreeMemBegin;
+    char* pFreeMemEnd;
+    struct slab_Slab* pEmptySlab; /* singly linked through `pNext` */
+    struct slab_Class classes[SLAB_CLASS_COUNT];
+    unsigned char lookup[SLAB_LOOKUP_SIZE];
+};
+
+#define slab_alignof(type) offsetof(struct {char x; type y;}, y)
+
+static void* slab_alignUp(void* ptr, size_t align)
+{
+    return (char*)ptr + (align - ((((size_t)ptr - 1) % align) + 1));
+}
+
+static struct slab_Slab* slab_slabOf(const void* pBlock)
+{
+    return (struct slab_Slab*)((size_t)pBlock & ~(size_t)(SLAB_SIZE - 1));
+}
+
+static void slab_unlink(struct slab_Class* pClass, struct slab_Slab* pSlab)
+{
+    if (pSlab->pPrev != NULL) pSlab->pPrev->pNext = pSlab->pNext;
+    else pClass->pPartial = pSlab->pNext;
+    if (pSlab->pNext != NULL) pSlab->pNext->pPrev = pSlab->pPrev;
+}
+
+static void slab_pushPartial(struct slab_Class* pClass, struct slab_Slab* pSlab)
+{
+    pSlab->pPrev = NULL;
+    pSlab->pNext = pClass->pPartial;
+    if (pClass->pPartial != NULL) pClass->pPartial->pPrev = pSlab;
+    pClass->pPartial = pSlab;
+}
+
+/* takes an empty slab and emplaces a block allocator for a class in it */
+static struct slab_Slab* slab_newSlab(
+    SlabAllocator* pAllocator,
+    size_t classIndex)
+{
+    struct slab_Slab* pSlab = pAllocator->pEmptySlab;
+    size_t size = slab_classSizes[classIndex];
+    size_t align = 16;
+    
+    if (pSlab != NULL) {
+        pAllocator->pEmptySlab = pSlab->pNext;
+    }
+    else {
+        if (pAllocator->pFreeMemBegin >= pAllocator->pFreeMemEnd) return NULL;
+        pSlab = (struct slab_Slab*)pAllocator->pFreeMemBegin;
+        pAllocator->pFreeMemBegin += SLAB_SIZE;
+    }
+    
+    while (size % align != 0) align /= 2;
+    pSlab->pBlocks = fsbaEmplaceAllocator(
+        pSlab + 1,
+        SLAB_SIZE - sizeof *pSlab,
+        size,
+        align,
+        &pSlab->blockCount);
+    pSlab->classIndex = classIndex;
+    pSlab->liveCount = 0;
+    return pSlab;
+}
+
+SlabAllocator* slabEmplaceAllocator(void* pMem, size_t memSize)
+{
+    SlabAllocator* pAllocator;
+    char* pSlabMemBegin;
+    size_t memUsed, size, i;
+    
+    if (pMem == NULL) return NULL;
+    
+    /* place the allocator in the first address aligned to hold it */
+    pAllocator = slab_alignUp(pMem, slab_alignof(SlabAllocator));
+    
+    /* slabs begin at the first slab boundary after the allocator */
+    pSlabMemBegin = slab_alignUp(pAllocator + 1, SLAB_SIZE);
+    
+    memUsed = (size_t)(pSlabMemBegin - (char*)pMem);
+    if (memUsed > memSize || memSize - memUsed < SLAB_SIZE) return NULL;
+    
+    pAllocator->pFreeMemBegin = pSlabMemBegin;
+    pAllocator->pFreeMemEnd = pSlabMemBegin
+        + (memSize - memUsed) / SLAB_SIZE * SLAB_SIZE;
+    pAllocator->pEmptySlab = NULL;
+    for (i = 0; i < SLAB_CLASS_COUNT; ++i) {
+        pAllocator->classes[i].pPartial = NULL;
+    }
+    
+    /* map every size to the smallest class that holds it */
+    for (size = 0, i = 0; size < SLAB_LOOKUP_SIZE; ++size) {
+        while (slab_classSizes[i] < size * 8) ++i;
+        pAllocator->lookup[size] = (unsigned char)i;
+    }
+    
+    return pAllocator;
+}
+
+void* slabAllocate(SlabAllocator* pAllocator, size_t size)
+{
+    struct slab_Class* pClass;
+    struct slab_Slab* pSlab;
+    void* out;
+    size_t classIndex;
+    
+    if (size > SLAB_MAX_SIZE) return NULL;
+    classIndex = pAllocator->lookup[(size + 7) / 8];
+    pClass = &pAllocator->classes[classIndex];
+    
+    pSlab = pClass->pPartial;
+    if (pSlab == NULL) {
+        pSlab = slab_newSlab(pAllocator, classIndex);
+        if (pSlab == NULL) return NULL;
+        slab_pushPartial(pClass, pSlab);
+    }
+    
+    /* a slab on the partial list always has a free block */
+    out = fsbaAllocate(pSlab->pBlocks);
+    pSlab->liveCount += 1;
+    if (pSlab->liveCount == pSlab->blockCount) slab_unlink(pClass, pSlab);
+    return out;
+}
+
+void slabFree(SlabAllocator* pAllocator, void* pBlock)
+{
+    struct slab_Slab* pSlab;
+    struct slab_Class* pClass;
+    
+    if (pBlock == NULL) return;
+    pSlab = slab_slabOf(pBlock);
+    pClass = &pAllocator->classes[pSlab->classIndex];
+    
+    fsbaFree(pSlab->pBlocks, pBlock);
+    if (pSlab->liveCount == pSlab->blockCount) slab_pushPartial(pClass, pSlab);
+    pSlab->liveCount -= 1;
+    
+    /*  Hand the slab back once it is empty, unless it is the only one left for
+     *  its class, so that a single block going back and forth does not
+     *  re-emplace a slab every time.
+     */
+    if (pSlab->liveCount == 0 && (pSlab->pPrev != NULL || pSlab->pNext != NULL)) {
+        slab_unlink(pClass, pSlab);
+        pSlab->pNext = pAllocator->pEmptySlab;
+        pAllocator->pEmptySlab = pSlab;
+    }
+}
+
+size_t slabUsableSize(const void* pBlock)
+{
+    return slab_classSizes[slab_slabOf(pBlock)->classIndex];
+}
+
+#undef slab_alignof
+
+#endif /* SLAB_ALLOCATOR_IMPLEMENTATION */
+
+/*
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or
+distribute this software, either in source code form or as a compiled
+binary, for any purpose, commercial or non-commercial, and by any
+means.
+
+In jurisdictions that recognize copyright laws, the author or authors
+of this software dedicate any and all copyright interest in the
+software to the public domain. We make this dedication for the benefit
+of the public at large and to the detriment of our heirs and
+successors. We intend this dedication to be an overt act of
+relinquishment in perpetuity of all present and future rights to this
+software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+
+For more information, please refer to <http://unlicense.org/>
+
+*/